@@ -0,0 +1,89 @@
+// Header files
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "arena.h"
+#include "types.h"
+
+/* Reserve the arena, with large pages when the system has them */
+Status arena_init(Arena *arena, size_t size){
+
+    memset(arena, 0, sizeof(*arena));
+    size = (size + ARENA_HUGE_PAGE_SIZE - 1) / ARENA_HUGE_PAGE_SIZE * ARENA_HUGE_PAGE_SIZE;
+
+    //Step 1 : Reserve the address space only. MAP_HUGETLB is not used, with NORESERVE a
+    //         missing huge page would fault (EFAULT / SIGBUS) instead of failing the mmap
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED){
+        return failure;
+    }
+
+    //Step 2 : Transparent huge pages where the kernel has them enabled
+    arena->huge_pages = (madvise(base, size, MADV_HUGEPAGE) == 0);
+
+    arena->base = base;
+    arena->size = size;
+    return success;
+}
+
+/* Memory for the current job : from the arena, or from malloc when arena is NULL */
+void *arena_alloc(Arena *arena, size_t size){
+
+    if (arena == NULL){
+        return malloc(size ? size : 1);
+    }
+
+    //Step 1 : Bump the offset
+    size_t aligned = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (aligned >= size && aligned <= arena->size - arena->used){
+        void *ptr = arena->base + arena->used;
+        arena->used += aligned;
+        if (arena->used > arena->peak){
+            arena->peak = arena->used;
+        }
+        return ptr;
+    }
+
+    //Step 2 : Too large for what is left, malloc it until the reset
+    ArenaOverflow *block = malloc(ARENA_ALIGN + size);
+    if (block == NULL){
+        return NULL;
+    }
+    block->next = arena->overflow;
+    arena->overflow = block;
+    arena->overflows++;
+    return (char *)block + ARENA_ALIGN;
+}
+
+/* Give back memory of arena_alloc, only needed (and only done) when arena is NULL */
+void arena_free(Arena *arena, void *ptr){
+
+    if (arena == NULL){
+        free(ptr);
+    }
+}
+
+/* Release everything the current job got, the pages stay mapped */
+void arena_reset(Arena *arena){
+
+    if (arena == NULL){
+        return;
+    }
+    while (arena->overflow != NULL){
+        ArenaOverflow *block = arena->overflow;
+        arena->overflow = block->next;
+        free(block);
+    }
+    arena->used = 0;
+}
+
+/* Unmap the arena */
+void arena_destroy(Arena *arena){
+
+    if (arena == NULL || arena->base == NULL){
+        return;
+    }
+    arena_reset(arena);
+    munmap(arena->base, arena->size);
+    arena->base = NULL;
+}
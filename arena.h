@@ -0,0 +1,56 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/*
+ * Per worker arena for job scoped memory : a bump allocator over one
+ * reserved mapping, reset in O(1) between jobs. The pages stay resident
+ * across resets, so a worker in steady state neither calls malloc nor
+ * faults pages in, and its RSS stays at the size of its largest job.
+ * Allocations that don't fit go to malloc and are freed by the reset.
+ */
+
+/* Header Files */
+#include <stddef.h>
+#include "types.h"
+
+/* Address space reserved per arena, pages are only backed once touched */
+#define ARENA_DEFAULT_SIZE ((size_t)256 * 1024 * 1024)
+
+/* Alignment of every allocation, a cache line */
+#define ARENA_ALIGN 64
+
+/* Large page size the reservation is rounded to */
+#define ARENA_HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+typedef struct ArenaOverflow
+{
+    struct ArenaOverflow *next;
+} ArenaOverflow;
+
+typedef struct Arena
+{
+    char *base;
+    size_t size;                 // Reserved bytes
+    size_t used;                 // Bytes handed out since the last reset
+    size_t peak;                 // Largest used, the resident part
+    int huge_pages;              // Transparent huge pages were requested
+    ArenaOverflow *overflow;     // malloc blocks of the current job
+    size_t overflows;            // Allocations that went to malloc, since arena_init
+} Arena;
+
+/* Reserve the arena, with large pages when the system has them */
+Status arena_init(Arena *arena, size_t size);
+
+/* Memory for the current job : from the arena, or from malloc when arena is NULL */
+void *arena_alloc(Arena *arena, size_t size);
+
+/* Give back memory of arena_alloc, only needed (and only done) when arena is NULL */
+void arena_free(Arena *arena, void *ptr);
+
+/* Release everything the current job got, the pages stay mapped */
+void arena_reset(Arena *arena);
+
+/* Unmap the arena */
+void arena_destroy(Arena *arena);
+
+#endif
@@ -0,0 +1,302 @@
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "batch.h"
+#include "uring_jobs.h"
+#include "encode.h"
+#include "decode.h"
+#include "stream.h"
+#include "carrier.h"
+#include "stats.h"
+#include "types.h"
+
+/* Per worker queue of job indexes, the owner takes from the head and thieves from the tail */
+typedef struct BatchQueue
+{
+    pthread_mutex_t lock;
+    size_t *jobs;
+    size_t head;
+    size_t tail;
+} BatchQueue;
+
+/* State shared by the workers */
+typedef struct BatchPool
+{
+    BatchJob *jobs;
+    BatchQueue *queues;
+    int workers;
+} BatchPool;
+
+typedef struct BatchWorker
+{
+    BatchPool *pool;
+    int id;
+    Arena arena;         // Memory of the current job, reset between jobs
+} BatchWorker;
+
+/* Read the manifest into an array of jobs */
+Status read_batch_manifest(const char *manifest_fname, BatchJob **jobs, size_t *count){
+
+    FILE *fptr = fopen(manifest_fname, "r");
+    if (fptr == NULL){
+        perror("fopen");
+        fprintf(stderr, "ERROR : Unable to open file %s\n", manifest_fname);
+        return failure;
+    }
+
+    char line[BATCH_MAX_LINE];
+    size_t capacity = 0;
+    int line_no = 0;
+    *jobs = NULL;
+    *count = 0;
+
+    while (fgets(line, sizeof(line), fptr) != NULL){
+
+        line_no++;
+
+        //Step 1 : Drop the comment and split the line into fields
+        char *hash = strchr(line, '#');
+        if (hash != NULL){
+            *hash = '\0';
+        }
+
+        char *fields[4];
+        int nfields = 0;
+        for (char *tok = strtok(line, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")){
+            if (nfields == 4){
+                break;
+            }
+            fields[nfields++] = tok;
+        }
+
+        if (nfields == 0){
+            continue;
+        }
+        if (nfields != 2 && nfields != 3){
+            printf("ERROR : %s:%d : expected <carrier> <secret> <output> or <stego> <output>\n", manifest_fname, line_no);
+            fclose(fptr);
+            return failure;
+        }
+
+        //Step 2 : Store the job
+        if (*count == capacity){
+            capacity = capacity ? capacity * 2 : 64;
+            BatchJob *grown = realloc(*jobs, capacity * sizeof(BatchJob));
+            if (grown == NULL){
+                printf("ERROR : Out of memory reading the manifest\n");
+                fclose(fptr);
+                return failure;
+            }
+            *jobs = grown;
+        }
+
+        BatchJob *job = &(*jobs)[(*count)++];
+        memset(job, 0, sizeof(*job));
+        job->type = (nfields == 3) ? e_encode : e_decode;
+        job->line = line_no;
+        job->status = failure;
+        for (int i = 0; i < nfields; i++){
+            job->args[i] = strdup(fields[i]);
+            if (job->args[i] == NULL){
+                printf("ERROR : Out of memory reading the manifest\n");
+                fclose(fptr);
+                return failure;
+            }
+        }
+    }
+
+    fclose(fptr);
+    return success;
+}
+
+/* Run one job with the memory mapped encoder/decoder, its memory comes from arena (NULL for malloc).
+ * A WAV carrier is streamed, its carrier bytes are not one run */
+Status run_batch_job(BatchJob *job, Arena *arena){
+
+    // argv as the -e / -d command line would give it
+    char *argv[6] = { "batch", NULL, job->args[0], job->args[1], job->args[2], NULL };
+    const CarrierBackend *backend = carrier_backend_for_name(job->args[0]);
+    int streamed = backend != NULL && backend->streamed;
+
+    if (job->type == e_encode){
+        EncodeInfo enc_info = {0};
+        argv[1] = "-e";
+        if (read_and_validate_encode_args(argv, &enc_info) != success){
+            return failure;
+        }
+        enc_info.threads = 1;
+        enc_info.quiet = 1;
+        enc_info.arena = arena;
+        return streamed ? do_encoding_stream(&enc_info, -1) : do_encoding_mmap(&enc_info);
+    }
+    else{
+        DecodeInfo dec_info = {0};
+        argv[1] = "-d";
+        if (read_and_validate_decode_args(argv, &dec_info) != success){
+            return failure;
+        }
+        dec_info.threads = 1;
+        dec_info.quiet = 1;
+        dec_info.arena = arena;
+        return streamed ? do_decoding_stream(&dec_info, -1) : do_decoding_mmap(&dec_info);
+    }
+}
+
+/* Take the next job : own queue first, otherwise steal from the tail of another one */
+static int next_job(BatchPool *pool, int id, size_t *index){
+
+    for (int i = 0; i < pool->workers; i++){
+
+        BatchQueue *queue = &pool->queues[(id + i) % pool->workers];
+        int found = 0;
+
+        pthread_mutex_lock(&queue->lock);
+        if (queue->head < queue->tail){
+            *index = (i == 0) ? queue->jobs[queue->head++] : queue->jobs[--queue->tail];
+            found = 1;
+        }
+        pthread_mutex_unlock(&queue->lock);
+
+        if (found){
+            return 1;
+        }
+    }
+
+    // Jobs are never added after the start, so empty queues mean we are done
+    return 0;
+}
+
+static void *batch_worker(void *arg){
+
+    BatchWorker *worker = arg;
+    size_t index;
+
+    arena_init(&worker->arena, ARENA_DEFAULT_SIZE);
+    while (next_job(worker->pool, worker->id, &index)){
+        BatchJob *job = &worker->pool->jobs[index];
+        double start = stats_now();
+        job->status = run_batch_job(job, &worker->arena);
+        job->seconds = stats_now() - start;
+        arena_reset(&worker->arena);
+    }
+    arena_destroy(&worker->arena);
+    return NULL;
+}
+
+/* Print the per job results and the summary */
+static void print_batch_report(const BatchJob *jobs, size_t count, double wall){
+
+    size_t failed = 0;
+    double busy = 0;
+
+    printf("#################### Batch Report ####################\n");
+    for (size_t i = 0; i < count; i++){
+        printf("%-6s line %-5d %-4s %9.3f ms  %s\n",
+               jobs[i].status == success ? "OK" : "FAILED", jobs[i].line,
+               jobs[i].type == e_encode ? "-e" : "-d", jobs[i].seconds * 1e3, jobs[i].args[0]);
+        failed += (jobs[i].status != success);
+        busy += jobs[i].seconds;
+    }
+    printf("Jobs : %zu, succeeded : %zu, failed : %zu\n", count, count - failed, failed);
+    printf("Wall time : %.3f ms, job time : %.3f ms\n", wall * 1e3, busy * 1e3);
+}
+
+/* Free the jobs, success when all of them succeeded */
+static Status free_batch_jobs(BatchJob *jobs, size_t count){
+
+    Status status = success;
+    for (size_t i = 0; i < count; i++){
+        if (jobs[i].status != success){
+            status = failure;
+        }
+        for (int a = 0; a < 3; a++){
+            free(jobs[i].args[a]);
+        }
+    }
+    free(jobs);
+
+    return status;
+}
+
+/* Run all the jobs of the manifest on a pool of worker threads, or on one io_uring, and print a report */
+Status do_batch(const char *manifest_fname, int threads, int use_uring){
+
+    BatchJob *jobs;
+    size_t count;
+
+    //Step 1 : Read the manifest
+    if (read_batch_manifest(manifest_fname, &jobs, &count) != success){
+        return failure;
+    }
+
+    //Step 2 : With io_uring this thread keeps the I/O of many jobs in flight, no pool needed
+    if (use_uring){
+        double start = stats_now();
+        if (run_jobs_uring(jobs, count, 1, 0) == success){
+            print_batch_report(jobs, count, stats_now() - start);
+            return free_batch_jobs(jobs, count);
+        }
+        printf("INFO : io_uring is not available, using the worker threads\n");
+    }
+
+    //Step 3 : Size the pool, by default one worker per online CPU
+    if (threads <= 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? cpus : 1;
+    }
+    if ((size_t)threads > count){
+        threads = count ? count : 1;
+    }
+
+    //Step 4 : Deal the jobs round robin into the worker queues
+    BatchQueue queues[threads];
+    BatchWorker workers[threads];
+    pthread_t tids[threads];
+    BatchPool pool = { jobs, queues, threads };
+    size_t *slots = malloc((count + 1) * sizeof(size_t));
+    size_t per_queue = (count + threads - 1) / threads;
+    if (slots == NULL){
+        printf("ERROR : Out of memory queueing the jobs\n");
+        free_batch_jobs(jobs, count);
+        return failure;
+    }
+
+    for (int w = 0; w < threads; w++){
+        pthread_mutex_init(&queues[w].lock, NULL);
+        queues[w].jobs = slots + w * per_queue;
+        queues[w].head = queues[w].tail = 0;
+        workers[w] = (BatchWorker){ &pool, w, {0} };
+    }
+    for (size_t i = 0; i < count; i++){
+        BatchQueue *queue = &queues[i % threads];
+        queue->jobs[queue->tail++] = i;
+    }
+
+    //Step 5 : Run the workers, this thread is worker 0
+    double start = stats_now();
+    int started = 1;
+    for (int w = 1; w < threads; w++){
+        if (pthread_create(&tids[w], NULL, batch_worker, &workers[w]) != 0){
+            break;
+        }
+        started++;
+    }
+    batch_worker(&workers[0]);
+    for (int w = 1; w < started; w++){
+        pthread_join(tids[w], NULL);
+    }
+    double wall = stats_now() - start;
+
+    //Step 6 : Report and free
+    print_batch_report(jobs, count, wall);
+
+    for (int w = 0; w < threads; w++){
+        pthread_mutex_destroy(&queues[w].lock);
+    }
+    free(slots);
+
+    return free_batch_jobs(jobs, count);
+}
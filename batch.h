@@ -0,0 +1,37 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/* Header Files */
+#include <stddef.h>
+#include "types.h"
+#include "arena.h"
+
+/*
+ * Manifest format, one job per line, '#' starts a comment :
+ *     <carrier image> <secret file> <output image>     encode
+ *     <stego image> <output file>                      decode
+ */
+
+/* Longest manifest line */
+#define BATCH_MAX_LINE 4096
+
+/* One job of the manifest */
+typedef struct BatchJob
+{
+    OperationType type;  // e_encode or e_decode
+    int line;            // Line number in the manifest
+    char *args[3];       // Carrier, secret, output / stego, output
+    Status status;       // Result of the job
+    double seconds;      // Wall time of the job
+} BatchJob;
+
+/* Read the manifest into an array of jobs */
+Status read_batch_manifest(const char *manifest_fname, BatchJob **jobs, size_t *count);
+
+/* Run one job with the memory mapped encoder/decoder, its memory comes from arena (NULL for malloc) */
+Status run_batch_job(BatchJob *job, Arena *arena);
+
+/* Run all the jobs of the manifest on a pool of worker threads, or on one io_uring, and print a report */
+Status do_batch(const char *manifest_fname, int threads, int use_uring);
+
+#endif
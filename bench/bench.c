@@ -0,0 +1,286 @@
+/***********************************************************************************
+ *
+ * Benchmark for the LSB kernels and the end to end encode/decode pipeline.
+ *
+ * Build from the top directory :
+ *     gcc -O2 -pthread -I. bench/bench.c $(ls *.c | grep -v main.c) -o stego_bench -lm
+ *
+ * Every result is one JSON object per line on stdout.
+ *
+ ***********************************************************************************/
+
+/* Header Files */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "stats.h"
+#include "types.h"
+#include "encode.h"
+#include "decode.h"
+#include "lsb.h"
+
+/* Carrier sizes in megapixels and payload sizes in bytes */
+static const double carrier_mp[] = { 1, 4, 16, 64, 200 };
+static const size_t payload_sizes[] = { 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024 };
+
+/* Minimum time spent on every kernel measurement */
+#define KERNEL_MIN_SECONDS 0.2
+
+/* Cheap pseudo random bytes */
+static void fill_random(char *buffer, size_t size, unsigned long long *state){
+
+    for (size_t i = 0; i < size; i++){
+        *state ^= *state << 13;
+        *state ^= *state >> 7;
+        *state ^= *state << 17;
+        buffer[i] = *state >> 24;
+    }
+}
+
+/* Write a synthetic 24 bit BMP of about mp megapixels, returns the pixel bytes */
+static size_t write_bmp(const char *fname, double mp){
+
+    // Width multiple of 4, so the rows have no padding
+    unsigned int width = ((unsigned int)sqrt(mp * 1e6) + 3) & ~3u;
+    unsigned int height = (unsigned int)(mp * 1e6 / width);
+    unsigned int pixels = width * height * 3;
+    unsigned int file_size = 54 + pixels;
+    unsigned char header[54] = { 'B', 'M' };
+
+    memcpy(header + 2, &file_size, 4);
+    header[10] = 54;
+    header[14] = 40;
+    memcpy(header + 18, &width, 4);
+    memcpy(header + 22, &height, 4);
+    header[26] = 1;
+    header[28] = 24;
+    memcpy(header + 34, &pixels, 4);
+
+    FILE *fptr = fopen(fname, "w");
+    if (fptr == NULL){
+        perror("fopen");
+        return 0;
+    }
+    fwrite(header, 54, 1, fptr);
+
+    char block[1 << 16];
+    unsigned long long state = 88172645463325252ULL;
+    for (size_t done = 0; done < pixels; done += sizeof(block)){
+        size_t n = (pixels - done < sizeof(block)) ? pixels - done : sizeof(block);
+        fill_random(block, n, &state);
+        fwrite(block, n, 1, fptr);
+    }
+    fclose(fptr);
+
+    return pixels;
+}
+
+/* Write a random payload of size bytes */
+static Status write_payload(const char *fname, size_t size){
+
+    FILE *fptr = fopen(fname, "w");
+    if (fptr == NULL){
+        perror("fopen");
+        return failure;
+    }
+
+    char block[1 << 16];
+    unsigned long long state = 2463534242ULL;
+    for (size_t done = 0; done < size; done += sizeof(block)){
+        size_t n = (size - done < sizeof(block)) ? size - done : sizeof(block);
+        fill_random(block, n, &state);
+        fwrite(block, n, 1, fptr);
+    }
+    fclose(fptr);
+
+    return success;
+}
+
+/* Print one kernel result */
+static void report_kernel(const char *op, size_t bytes, double seconds){
+
+    printf("{\"bench\":\"kernel\",\"kernel\":\"%s\",\"op\":\"%s\",\"bytes\":%zu,\"mb_per_s\":%.2f,\"ns_per_byte\":%.3f}\n",
+           lsb_kernel_name(), op, bytes, bytes / seconds / 1e6, seconds * 1e9 / bytes);
+}
+
+/* The byte and bulk kernels in isolation, over a payload of size bytes */
+static void bench_kernels(size_t size){
+
+    char *data = malloc(size);
+    char *image = malloc(size * 8);
+    unsigned long long state = 1;
+    fill_random(data, size, &state);
+    fill_random(image, size * 8, &state);
+
+    size_t reps;
+    double start, seconds;
+
+    // encode_byte_to_lsb, one call per data byte
+    for (reps = 0, start = stats_now(); (seconds = stats_now() - start) < KERNEL_MIN_SECONDS; reps++){
+        for (size_t i = 0; i < size; i++){
+            encode_byte_to_lsb(data[i], image + i * 8);
+        }
+    }
+    report_kernel("encode_byte_to_lsb", size * reps, seconds);
+
+    // decode_byte_from_lsb, one call per data byte
+    for (reps = 0, start = stats_now(); (seconds = stats_now() - start) < KERNEL_MIN_SECONDS; reps++){
+        for (size_t i = 0; i < size; i++){
+            decode_byte_from_lsb(&data[i], image + i * 8);
+        }
+    }
+    report_kernel("decode_byte_from_lsb", size * reps, seconds);
+
+    // Bulk kernels
+    for (reps = 0, start = stats_now(); (seconds = stats_now() - start) < KERNEL_MIN_SECONDS; reps++){
+        encode_data_to_lsb(data, size, image);
+    }
+    report_kernel("encode_data_to_lsb", size * reps, seconds);
+
+    for (reps = 0, start = stats_now(); (seconds = stats_now() - start) < KERNEL_MIN_SECONDS; reps++){
+        decode_data_from_lsb(data, size, image);
+    }
+    report_kernel("decode_data_from_lsb", size * reps, seconds);
+
+    free(data);
+    free(image);
+}
+
+/* Run fn with stdout sent to /dev/null, the pipeline prints INFO lines */
+static double timed_quiet(Status (*fn)(void *), void *arg, Status *status){
+
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    close(null_fd);
+
+    double start = stats_now();
+    *status = fn(arg);
+    fflush(stdout);
+    double seconds = stats_now() - start;
+
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    return seconds;
+}
+
+static Status run_encode_stdio(void *arg){
+
+    EncodeInfo *enc_info = arg;
+    Status status = do_encoding(enc_info);
+    if (enc_info->fptr_src_image) fclose(enc_info->fptr_src_image);
+    if (enc_info->fptr_secret) fclose(enc_info->fptr_secret);
+    if (enc_info->fptr_stego_image) fclose(enc_info->fptr_stego_image);
+    return status;
+}
+
+static Status run_encode_mmap(void *arg){
+
+    return do_encoding_mmap(arg);
+}
+
+static Status run_decode_stdio(void *arg){
+
+    return do_decoding(arg);
+}
+
+static Status run_decode_mmap(void *arg){
+
+    return do_decoding_mmap(arg);
+}
+
+/* Full do_encoding / do_decoding wall time for one carrier and payload */
+static void bench_pipeline(const char *dir, double mp, size_t payload){
+
+    char carrier[512], secret[512], stego[512], output[512];
+    snprintf(carrier, sizeof(carrier), "%s/bench_carrier.bmp", dir);
+    snprintf(secret, sizeof(secret), "%s/bench_secret.bin", dir);
+    snprintf(stego, sizeof(stego), "%s/bench_stego.bmp", dir);
+    snprintf(output, sizeof(output), "%s/bench_output.bin", dir);
+
+    if (write_payload(secret, payload) != success){
+        return;
+    }
+
+    const char *paths[] = { "stdio", "mmap" };
+    for (int p = 0; p < 2; p++){
+
+        EncodeInfo enc_info = {0};
+        DecodeInfo dec_info = {0};
+        char *enc_argv[] = { "bench", "-e", carrier, secret, stego, NULL };
+        char *dec_argv[] = { "bench", "-d", stego, output, NULL };
+        Status enc_status = failure, dec_status = failure;
+        double enc_seconds = 0, dec_seconds = 0;
+
+        read_and_validate_encode_args(enc_argv, &enc_info);
+        enc_info.quiet = 1;
+        enc_seconds = timed_quiet(p ? run_encode_mmap : run_encode_stdio, &enc_info, &enc_status);
+
+        if (enc_status == success){
+            read_and_validate_decode_args(dec_argv, &dec_info);
+            dec_info.quiet = 1;
+            dec_seconds = timed_quiet(p ? run_decode_mmap : run_decode_stdio, &dec_info, &dec_status);
+        }
+
+        printf("{\"bench\":\"pipeline\",\"path\":\"%s\",\"megapixels\":%g,\"payload\":%zu,"
+               "\"encode_ok\":%s,\"encode_seconds\":%.6f,\"decode_ok\":%s,\"decode_seconds\":%.6f}\n",
+               paths[p], mp, payload, enc_status == success ? "true" : "false", enc_seconds,
+               dec_status == success ? "true" : "false", dec_seconds);
+        fflush(stdout);
+    }
+
+    unlink(secret);
+    unlink(stego);
+    unlink(output);
+}
+
+int main(int argc, char *argv[]){
+
+    double max_mp = 200;
+    const char *dir = "/tmp";
+
+    // Step 1 : Options
+    for (int i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--max-mp") == 0 && i + 1 < argc){
+            max_mp = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc){
+            dir = argv[++i];
+        }
+        else{
+            printf("Usage: %s [--max-mp N] [--dir DIR]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Step 2 : Kernels in isolation
+    for (size_t i = 0; i < sizeof(payload_sizes) / sizeof(payload_sizes[0]); i++){
+        bench_kernels(payload_sizes[i]);
+    }
+
+    // Step 3 : Full pipeline, payloads from 1 KB up to the capacity of every carrier
+    for (size_t c = 0; c < sizeof(carrier_mp) / sizeof(carrier_mp[0]) && carrier_mp[c] <= max_mp; c++){
+
+        char carrier[512];
+        snprintf(carrier, sizeof(carrier), "%s/bench_carrier.bmp", dir);
+        size_t pixels = write_bmp(carrier, carrier_mp[c]);
+        if (pixels == 0){
+            return 1;
+        }
+
+        // Leave room for the header fields
+        size_t capacity = pixels / 8 - 64;
+        for (size_t p = 0; p < sizeof(payload_sizes) / sizeof(payload_sizes[0]) && payload_sizes[p] < capacity; p++){
+            bench_pipeline(dir, carrier_mp[c], payload_sizes[p]);
+        }
+        bench_pipeline(dir, carrier_mp[c], capacity);
+
+        unlink(carrier);
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Header files
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "bmp.h"
+#include "carrier.h"
+#include "types.h"
+
+/* Little endian fields of the header */
+static uint32_t get_u32(const char *buffer){
+
+    const unsigned char *b = (const unsigned char *)buffer;
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint16_t get_u16(const char *buffer){
+
+    const unsigned char *b = (const unsigned char *)buffer;
+    return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+/* Parse the header from the first bytes of the file */
+Status bmp_parse_header(const char *buffer, size_t size, CarrierInfo *bmp){
+
+    //Step 1 : "BM" signature and a BITMAPINFOHEADER or a later version of it
+    if (size < BMP_HEADER_SIZE || buffer[0] != 'B' || buffer[1] != 'M' || get_u32(buffer + 14) < 40){
+        return failure;
+    }
+
+    //Step 2 : Offsets and dimensions, a negative height means the rows are stored top down
+    int32_t height = (int32_t)get_u32(buffer + 22);
+    uint32_t compression = get_u32(buffer + 30);
+    if (height == INT32_MIN){
+        return failure;
+    }
+
+    bmp->pixel_offset = get_u32(buffer + 10);
+    bmp->width = (int32_t)get_u32(buffer + 18);
+    bmp->sample_size = 1;
+    bmp->height = height < 0 ? -height : height;
+    bmp->bpp = get_u16(buffer + 28);
+    bmp->extn = ".bmp";
+
+    //Step 3 : Only uncompressed 24 bit BGR and 32 bit BGRA pixels
+    if (bmp->width <= 0 || bmp->height <= 0 || bmp->pixel_offset < BMP_HEADER_SIZE ||
+        !((bmp->bpp == 24 && compression == 0) || (bmp->bpp == 32 && (compression == 0 || compression == 3)))){
+        return failure;
+    }
+
+    //Step 4 : Rows are padded to 4 bytes
+    size_t stride = (((size_t)bmp->width * bmp->bpp / 8) + 3) & ~(size_t)3;
+    bmp->pixel_size = stride * bmp->height;
+
+    return success;
+}
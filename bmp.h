@@ -0,0 +1,15 @@
+#ifndef BMP_H
+#define BMP_H
+
+/* Header Files */
+#include <stddef.h>
+#include "carrier.h"
+#include "types.h"
+
+/* BITMAPFILEHEADER + BITMAPINFOHEADER, the smallest header we accept */
+#define BMP_HEADER_SIZE 54
+
+/* Parse the header from the first bytes of the file, 24 bit BGR and 32 bit BGRA only */
+Status bmp_parse_header(const char *buffer, size_t size, CarrierInfo *bmp);
+
+#endif
@@ -0,0 +1,131 @@
+// Header files
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <unistd.h>
+#include "carrier.h"
+#include "bmp.h"
+#include "pnm.h"
+#include "tga.h"
+#include "wav.h"
+#include "types.h"
+
+/* The formats, tried in this order. TGA has no signature, it comes last */
+static const CarrierBackend backends[] = {
+    { "bmp", { ".bmp", NULL }, 0, bmp_parse_header },
+    { "pnm", { ".ppm", ".pgm", ".pnm", NULL }, 0, pnm_parse_header },
+    { "wav", { ".wav", NULL }, 1, wav_parse_header },
+    { "tga", { ".tga", NULL }, 0, tga_parse_header },
+};
+
+#define BACKEND_COUNT (sizeof(backends) / sizeof(backends[0]))
+
+/* Parse the header from the first bytes of the file, whatever its format */
+Status carrier_parse_header(const char *buffer, size_t size, CarrierInfo *carrier){
+
+    for (size_t i = 0; i < BACKEND_COUNT; i++){
+        memset(carrier, 0, sizeof(*carrier));
+        if (backends[i].parse_header(buffer, size, carrier) == success){
+            carrier->backend = &backends[i];
+            return success;
+        }
+    }
+    return failure;
+}
+
+/* Read and parse the header from the start of the file */
+Status carrier_read_header(FILE *fptr, CarrierInfo *carrier){
+
+    char buffer[CARRIER_HEADER_SIZE];
+
+    if (fseek(fptr, 0, SEEK_SET) != 0){
+        return failure;
+    }
+    size_t n = fread(buffer, 1, sizeof(buffer), fptr);
+    return carrier_parse_header(buffer, n, carrier);
+}
+
+/* Read and parse the header from the start of a file descriptor, a file shorter than the buffer is read whole */
+Status carrier_pread_header(int fd, CarrierInfo *carrier){
+
+    char buffer[CARRIER_HEADER_SIZE];
+    size_t size = 0;
+
+    while (size < sizeof(buffer)){
+        ssize_t n = pread(fd, buffer + size, sizeof(buffer) - size, size);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n < 0){
+            return failure;
+        }
+        if (n == 0){
+            break;
+        }
+        size += n;
+    }
+    return carrier_parse_header(buffer, size, carrier);
+}
+
+/* Backend a file name belongs to by its extension, NULL when it is not a carrier name */
+const CarrierBackend *carrier_backend_for_name(const char *fname){
+
+    const char *dot = strrchr(fname, '.');
+    if (dot == NULL || strchr(dot, '/') != NULL){
+        return NULL;
+    }
+    for (size_t i = 0; i < BACKEND_COUNT; i++){
+        for (const char *const *extn = backends[i].extns; *extn != NULL; extn++){
+            if (strcasecmp(dot, *extn) == 0){
+                return &backends[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+/* Bytes of the pixel array that a file of file_size bytes really holds */
+size_t carrier_pixel_region(const CarrierInfo *carrier, size_t file_size){
+
+    if (file_size <= carrier->pixel_offset){
+        return 0;
+    }
+    size_t available = file_size - carrier->pixel_offset;
+    return available < carrier->pixel_size ? available : carrier->pixel_size;
+}
+
+/* All the formats store their rows back to back, so the pixel array is one span */
+const char *carrier_pixels(const CarrierInfo *carrier, const char *file, size_t file_size, size_t *size){
+
+    *size = carrier_pixel_region(carrier, file_size);
+    return *size > 0 ? file + carrier->pixel_offset : file;
+}
+
+/* Copy the first byte of count samples into bytes */
+void carrier_gather(const CarrierInfo *carrier, const char *samples, size_t count, char *bytes){
+
+    if (carrier->sample_size == 2){
+        for (size_t i = 0; i < count; i++){
+            bytes[i] = samples[2 * i];
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; i++){
+        bytes[i] = samples[i * carrier->sample_size];
+    }
+}
+
+/* Put count bytes back as the first byte of the samples */
+void carrier_scatter(const CarrierInfo *carrier, const char *bytes, size_t count, char *samples){
+
+    if (carrier->sample_size == 2){
+        for (size_t i = 0; i < count; i++){
+            samples[2 * i] = bytes[i];
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; i++){
+        samples[i * carrier->sample_size] = bytes[i];
+    }
+}
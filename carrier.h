@@ -0,0 +1,76 @@
+#ifndef CARRIER_H
+#define CARRIER_H
+
+/* Header Files */
+#include <stdio.h>
+#include <stddef.h>
+#include "types.h"
+
+/*
+ * A carrier is any image format whose pixels are stored uncompressed, one
+ * byte per channel, in a single run after a header : BMP, binary PPM/PGM and
+ * TGA. Each format is a backend that only parses its header; the payload is
+ * embedded in the LSBs of the pixel run the same way for all of them, so the
+ * stego layout does not depend on the format. The run is taken as it is in
+ * the file, the padding at the end of BMP rows carries payload too, as it
+ * always has, so the rows and their order are not kept.
+ *
+ * A 16 bit PCM WAV file is a carrier too, its samples being the pixel run.
+ * Only the first (low) byte of each sample is a carrier byte, so it is read
+ * by the stream path only, which gathers these bytes, runs the same LSB
+ * kernels over them and puts them back.
+ */
+
+/* Bytes read from the start of a file to parse its header, the chunks of a WAV file before its data included */
+#define CARRIER_HEADER_SIZE 4096
+
+/* Widest sample, in bytes, of any format */
+#define CARRIER_MAX_SAMPLE_SIZE 2
+
+/* The header of a carrier, read once per file */
+typedef struct CarrierInfo
+{
+    const struct CarrierBackend *backend;   // Format of the file
+    const char *extn;       // File extension of the format, as written by stripe
+    size_t pixel_offset;    // First byte of the pixel array
+    int width;              // Pixels per row, channels for WAV
+    int height;             // Rows, always positive, frames for WAV
+    int bpp;                // Bits per pixel, 8, 24 or 32, per frame for WAV
+    size_t pixel_size;      // Bytes of the pixel array, row padding included
+    int sample_size;        // Bytes per sample, only the first one holds data : 1 for the images, 2 for WAV
+} CarrierInfo;
+
+/* One format : its name, its file extensions (NULL terminated) and its header parser */
+typedef struct CarrierBackend
+{
+    const char *name;
+    const char *extns[4];
+    int streamed;           // 1 when its carrier bytes are not one run, only the stream path reads it
+    Status (*parse_header)(const char *buffer, size_t size, CarrierInfo *carrier);
+} CarrierBackend;
+
+/* Parse the header from the first bytes of the file, whatever its format */
+Status carrier_parse_header(const char *buffer, size_t size, CarrierInfo *carrier);
+
+/* Read and parse the header from the start of the file */
+Status carrier_read_header(FILE *fptr, CarrierInfo *carrier);
+
+/* Read and parse the header from the start of a file descriptor, without moving its offset */
+Status carrier_pread_header(int fd, CarrierInfo *carrier);
+
+/* Backend a file name belongs to by its extension, NULL when it is not a carrier name */
+const CarrierBackend *carrier_backend_for_name(const char *fname);
+
+/* Bytes of the pixel array that a file of file_size bytes really holds */
+size_t carrier_pixel_region(const CarrierInfo *carrier, size_t file_size);
+
+/* The pixel array of a file mapped at file, as a span of *size bytes the LSB kernels run over, no copy is made */
+const char *carrier_pixels(const CarrierInfo *carrier, const char *file, size_t file_size, size_t *size);
+
+/* Copy the first byte of count samples into bytes */
+void carrier_gather(const CarrierInfo *carrier, const char *samples, size_t count, char *bytes);
+
+/* Put count bytes back as the first byte of the samples */
+void carrier_scatter(const CarrierInfo *carrier, const char *bytes, size_t count, char *samples);
+
+#endif
@@ -0,0 +1,380 @@
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "catalog.h"
+#include "encode.h"
+#include "scan.h"
+#include "stego.h"
+#include "carrier.h"
+#include "types.h"
+
+/* An index file as mapped, the entries and names point into the mapping */
+typedef struct CatalogView
+{
+    const char *map;
+    size_t map_size;
+    const CatalogEntry *entries;
+    size_t count;
+    const char *names;
+    size_t names_size;
+} CatalogView;
+
+/* Entry of the old index, looked up by path while refreshing */
+typedef struct CatalogOld
+{
+    const char *path;
+    const CatalogEntry *entry;
+    int seen;                  // Visited by the walk
+} CatalogOld;
+
+/* The index being built */
+typedef struct Catalog
+{
+    CatalogEntry *entries;
+    size_t count;
+    size_t capacity;
+    char *names;
+    size_t names_size;
+    size_t names_capacity;
+    CatalogOld *old;           // Old entries sorted by path
+    size_t old_count;
+    size_t read;               // Carriers whose header was read
+    size_t kept;               // Carriers unchanged since the old index
+    Status status;
+} Catalog;
+
+/* Map and check an index file, a missing file is an empty index when missing_ok */
+static Status catalog_open(const char *fname, CatalogView *view, int missing_ok){
+
+    struct stat st;
+    memset(view, 0, sizeof(*view));
+    if (missing_ok && stat(fname, &st) != 0){
+        return success;
+    }
+    if (map_file_read_only(fname, &view->map, &view->map_size) != success){
+        return failure;
+    }
+
+    //The header, the entries and the names have to fill the file exactly
+    const CatalogHeader *header = (const CatalogHeader *)view->map;
+    size_t version = strlen(CATALOG_MAGIC) - 1;
+    if (missing_ok && view->map_size >= sizeof(CatalogHeader) && memcmp(header->magic, CATALOG_MAGIC, version) == 0 &&
+        memcmp(header->magic, CATALOG_MAGIC, sizeof(header->magic)) != 0){
+        printf("INFO : %s is an index of an older version, it is built again\n", fname);
+        munmap((void *)view->map, view->map_size);
+        memset(view, 0, sizeof(*view));
+        return success;
+    }
+    if (view->map_size < sizeof(CatalogHeader) || memcmp(header->magic, CATALOG_MAGIC, sizeof(header->magic)) != 0 ||
+        header->count > (view->map_size - sizeof(CatalogHeader)) / sizeof(CatalogEntry) ||
+        header->names_size != view->map_size - sizeof(CatalogHeader) - header->count * sizeof(CatalogEntry) ||
+        (header->names_size > 0 && view->map[view->map_size - 1] != '\0')){
+        printf("ERROR : %s is not a carrier index\n", fname);
+        return failure;
+    }
+    view->entries = (const CatalogEntry *)(view->map + sizeof(CatalogHeader));
+    view->count = header->count;
+    view->names = (const char *)(view->entries + view->count);
+    view->names_size = header->names_size;
+    for (size_t i = 0; i < view->count; i++){
+        if (view->entries[i].name >= view->names_size){
+            printf("ERROR : %s is not a carrier index\n", fname);
+            return failure;
+        }
+    }
+    return success;
+}
+
+static void catalog_close(CatalogView *view){
+
+    if (view->map != NULL){
+        munmap((void *)view->map, view->map_size);
+    }
+    memset(view, 0, sizeof(*view));
+}
+
+/* Append an entry, the name is copied */
+static Status catalog_add(Catalog *catalog, const CatalogEntry *entry, const char *path){
+
+    size_t len = strlen(path) + 1;
+
+    if (catalog->count == catalog->capacity){
+        size_t capacity = catalog->capacity ? catalog->capacity * 2 : 256;
+        CatalogEntry *entries = realloc(catalog->entries, capacity * sizeof(*entries));
+        if (entries == NULL){
+            return failure;
+        }
+        catalog->entries = entries;
+        catalog->capacity = capacity;
+    }
+    if (catalog->names_size + len > catalog->names_capacity){
+        size_t capacity = catalog->names_capacity ? catalog->names_capacity * 2 : 16384;
+        while (capacity < catalog->names_size + len){
+            capacity *= 2;
+        }
+        char *names = realloc(catalog->names, capacity);
+        if (names == NULL){
+            return failure;
+        }
+        catalog->names = names;
+        catalog->names_capacity = capacity;
+    }
+
+    CatalogEntry *copy = &catalog->entries[catalog->count++];
+    *copy = *entry;
+    copy->name = catalog->names_size;
+    memcpy(catalog->names + catalog->names_size, path, len);
+    catalog->names_size += len;
+    return success;
+}
+
+/* Has the file changed since the entry was made */
+static int entry_changed(const CatalogEntry *entry, const struct stat *st){
+
+    return entry->file_size != (uint64_t)st->st_size || entry->mtime_sec != (int64_t)st->st_mtim.tv_sec ||
+           entry->mtime_nsec != (uint32_t)st->st_mtim.tv_nsec;
+}
+
+/* Read the image header of a new or changed file, fails for anything but a carrier */
+static Status read_entry(const char *path, const struct stat *st, CatalogEntry *entry){
+
+    CarrierInfo carrier;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0){
+        return failure;
+    }
+    Status status = carrier_pread_header(fd, &carrier);
+    close(fd);
+    if (status != success){
+        return failure;
+    }
+
+    memset(entry, 0, sizeof(*entry));
+    entry->region = carrier_pixel_region(&carrier, st->st_size) / carrier.sample_size;
+    entry->file_size = st->st_size;
+    entry->mtime_sec = st->st_mtim.tv_sec;
+    entry->mtime_nsec = st->st_mtim.tv_nsec;
+    entry->width = carrier.width;
+    entry->height = carrier.height;
+    entry->bpp = carrier.bpp;
+    entry->sample_size = carrier.sample_size;
+    entry->streamed = carrier.backend->streamed;
+    return success;
+}
+
+static int compare_old(const void *a, const void *b){
+
+    return strcmp(((const CatalogOld *)a)->path, ((const CatalogOld *)b)->path);
+}
+
+/* The names of the index being sorted, qsort has no context argument */
+static const char *sort_names;
+
+/* Smallest carrier first, then by path so that a file seen twice ends up next to itself */
+static int compare_entries(const void *a, const void *b){
+
+    const CatalogEntry *x = a, *y = b;
+    if (x->region != y->region){
+        return x->region < y->region ? -1 : 1;
+    }
+    return strcmp(sort_names + x->name, sort_names + y->name);
+}
+
+/* Walk callback : keep an unchanged entry, read a new or changed file */
+static void index_file(const char *path, void *arg){
+
+    Catalog *catalog = arg;
+    CatalogOld key = { path, NULL, 0 };
+    CatalogEntry entry;
+    struct stat st;
+
+    if (catalog->status != success || stat(path, &st) != 0){
+        return;
+    }
+    CatalogOld *old = catalog->old_count ? bsearch(&key, catalog->old, catalog->old_count, sizeof(*old), compare_old) : NULL;
+    if (old != NULL){
+        old->seen = 1;
+    }
+    if (old != NULL && !entry_changed(old->entry, &st)){
+        entry = *old->entry;
+        catalog->kept++;
+    }
+    else if (read_entry(path, &st, &entry) == success){
+        catalog->read++;
+    }
+    else{
+        return;
+    }
+    if (catalog_add(catalog, &entry, path) != success){
+        printf("ERROR : Out of memory for the carrier index\n");
+        catalog->status = failure;
+    }
+}
+
+/* Write the index next to its final name and move it over, a reader never sees half of it */
+static Status catalog_write(const char *fname, const Catalog *catalog){
+
+    char tmp_fname[4096];
+    CatalogHeader header = { CATALOG_MAGIC, catalog->count, catalog->names_size };
+
+    if ((size_t)snprintf(tmp_fname, sizeof(tmp_fname), "%s.tmp", fname) >= sizeof(tmp_fname)){
+        printf("ERROR : Index name %s is too long\n", fname);
+        return failure;
+    }
+    FILE *fptr = fopen(tmp_fname, "w");
+    if (fptr == NULL){
+        perror("fopen");
+        fprintf(stderr, "ERROR : Unable to open file %s\n", tmp_fname);
+        return failure;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, fptr) == 1 &&
+             fwrite(catalog->entries, sizeof(CatalogEntry), catalog->count, fptr) == catalog->count &&
+             fwrite(catalog->names, 1, catalog->names_size, fptr) == catalog->names_size;
+    if (fclose(fptr) != 0 || !ok || rename(tmp_fname, fname) != 0){
+        perror("write");
+        fprintf(stderr, "ERROR : Unable to write file %s\n", fname);
+        unlink(tmp_fname);
+        return failure;
+    }
+    return success;
+}
+
+/* Build the index of the image files under the paths, or refresh it : only the new and the changed files are read */
+Status do_index(const char *index_fname, char *paths[], int count){
+
+    Catalog catalog;
+    CatalogView view;
+    memset(&catalog, 0, sizeof(catalog));
+    catalog.status = success;
+
+    //Step 1 : The old index, sorted by path to look the walked files up
+    if (catalog_open(index_fname, &view, 1) != success){
+        catalog_close(&view);
+        return failure;
+    }
+    catalog.old = calloc(view.count ? view.count : 1, sizeof(*catalog.old));
+    if (catalog.old == NULL){
+        catalog_close(&view);
+        return failure;
+    }
+    for (size_t i = 0; i < view.count; i++){
+        catalog.old[i] = (CatalogOld){ view.names + view.entries[i].name, &view.entries[i], 0 };
+    }
+    catalog.old_count = view.count;
+    qsort(catalog.old, catalog.old_count, sizeof(*catalog.old), compare_old);
+
+    //Step 2 : Walk the paths, only the image header of a new or changed file is read
+    size_t walk_errors = scan_walk(paths, count, index_file, &catalog);
+
+    //Step 3 : Old entries outside the walk stay while their file is there, and are read again when it changed
+    size_t removed = 0;
+    for (size_t i = 0; i < catalog.old_count && catalog.status == success; i++){
+        struct stat st;
+        if (catalog.old[i].seen){
+            continue;
+        }
+        if (stat(catalog.old[i].path, &st) != 0){
+            removed++;
+        }
+        else{
+            index_file(catalog.old[i].path, &catalog);
+        }
+    }
+
+    //Step 4 : Sort by capacity, a file reached twice is kept once, and replace the index
+    Status status = catalog.status;
+    if (status == success){
+        sort_names = catalog.names;
+        qsort(catalog.entries, catalog.count, sizeof(CatalogEntry), compare_entries);
+        size_t unique = 0;
+        for (size_t i = 0; i < catalog.count; i++){
+            if (unique == 0 || strcmp(catalog.names + catalog.entries[i].name, catalog.names + catalog.entries[unique - 1].name) != 0){
+                catalog.entries[unique++] = catalog.entries[i];
+            }
+        }
+        catalog.count = unique;
+        status = catalog_write(index_fname, &catalog);
+    }
+    if (status == success){
+        printf("INFO : %zu carriers in %s, %zu headers read, %zu unchanged, %zu removed\n",
+               catalog.count, index_fname, catalog.read, catalog.kept, removed);
+    }
+
+    free(catalog.old);
+    free(catalog.entries);
+    free(catalog.names);
+    catalog_close(&view);
+    return (status == success && walk_errors == 0) ? success : failure;
+}
+
+/* Print the smallest carrier of the index that holds the secret at this depth and layout, no image is opened */
+Status do_fit(const char *index_fname, const char *secret_fname, int bits, const uint64_t key[2], size_t chunk_size){
+
+    EncodeInfo enc_info = {0};
+    StegoHeader header;
+    CatalogView view;
+    struct stat st;
+
+    //Step 1 : Pixel bytes the secret needs, from its size and name only
+    if (stat(secret_fname, &st) != 0){
+        perror("stat");
+        fprintf(stderr, "ERROR : Unable to find %s\n", secret_fname);
+        return failure;
+    }
+    get_secret_file_extn(secret_fname, enc_info.extn_secret_file);
+    enc_info.size_secret_file = st.st_size;
+    enc_info.bits = bits;
+    memcpy(enc_info.key, key, sizeof(enc_info.key));
+    enc_info.chunk_size = chunk_size;
+    fill_stego_header(&enc_info, &header);
+    size_t required = stego_required_size(&header);
+
+    //Step 2 : First entry with enough pixel bytes, the entries are sorted by them. The stream path
+    // of a WAV file has no key nor chunk layout, so these are skipped when either is asked for
+    int images_only = key[0] != 0 || key[1] != 0 || chunk_size != 0;
+    if (catalog_open(index_fname, &view, 0) != success){
+        catalog_close(&view);
+        return failure;
+    }
+    size_t lo = 0, hi = view.count;
+    while (lo < hi){
+        size_t mid = lo + (hi - lo) / 2;
+        if (view.entries[mid].region < required){
+            lo = mid + 1;
+        }
+        else{
+            hi = mid;
+        }
+    }
+    while (images_only && lo < view.count && view.entries[lo].streamed){
+        lo++;
+    }
+
+    //Step 3 : Print it
+    Status status = success;
+    if (lo == view.count){
+        printf("ERROR : No carrier in %s holds %zu bytes at k=%d, %zu pixel bytes are needed and the largest has %llu%s\n",
+               index_fname, enc_info.size_secret_file, header.bits, required,
+               view.count ? (unsigned long long)view.entries[view.count - 1].region : 0ULL,
+               images_only ? ", WAV files can't take --key nor --chunked" : "");
+        status = failure;
+    }
+    else if (view.entries[lo].streamed){
+        const CatalogEntry *entry = &view.entries[lo];
+        printf("%s : %u channels x %u frames %u bit audio, %zu of %llu sample bytes needed\n", view.names + entry->name,
+               entry->width, entry->height, entry->sample_size * 8, required, (unsigned long long)entry->region);
+    }
+    else{
+        const CatalogEntry *entry = &view.entries[lo];
+        printf("%s : %ux%u %u bpp, %zu of %llu pixel bytes needed\n", view.names + entry->name,
+               entry->width, entry->height, entry->bpp, required, (unsigned long long)entry->region);
+    }
+    catalog_close(&view);
+    return status;
+}
@@ -0,0 +1,52 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+/* Header Files */
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/*
+ * Carrier index file, in host byte order (it is a cache of the pool, rebuilt
+ * by index, not an exchange format) :
+ *     CatalogHeader | CatalogEntry x count | names
+ * The entries are sorted by pixel bytes, so the smallest carrier holding a
+ * payload is found with a binary search over the mapped file. The names are
+ * the carrier paths, each ending with '\0'. A WAV file is only read by the
+ * stream path, which has no key nor chunk layout, so its entry is marked.
+ */
+
+/* First bytes of an index file, the last digit is the version */
+#define CATALOG_MAGIC "LSBCAT2"
+
+typedef struct CatalogHeader
+{
+    char magic[8];          // CATALOG_MAGIC with its '\0'
+    uint64_t count;         // Entries
+    uint64_t names_size;    // Bytes of the names after the entries
+} CatalogHeader;
+
+/* One carrier, what is needed to pick it and to notice it changed */
+typedef struct CatalogEntry
+{
+    uint64_t region;        // Carrier bytes present in the file, pixel bytes or WAV samples
+    uint64_t file_size;
+    int64_t mtime_sec;
+    uint32_t mtime_nsec;
+    uint32_t width;         // Channels for WAV
+    uint32_t height;        // Frames for WAV
+    uint32_t bpp;
+    uint32_t sample_size;   // Bytes per sample, 2 for WAV
+    uint32_t streamed;      // 1 when only the stream path reads the carrier
+    uint32_t reserved;      // Zero, keeps the name offset aligned
+    uint64_t name;          // Offset of the path in the names
+} CatalogEntry;
+
+/* Build the index of the image files under the paths, or refresh it : only the new and the changed files are read */
+Status do_index(const char *index_fname, char *paths[], int count);
+
+/* Print the smallest carrier of the index that holds the secret at this depth and layout, no image is opened.
+ * A streamed carrier is only picked without a key and a chunk size */
+Status do_fit(const char *index_fname, const char *secret_fname, int bits, const uint64_t key[2], size_t chunk_size);
+
+#endif
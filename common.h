@@ -4,4 +4,16 @@
 /* Magic string to identify whether stegged or not */
 #define MAGIC_STRING "#*"
 
+/* Magic string of the extended format (k-LSB, flags), same length as MAGIC_STRING */
+#define MAGIC_STRING_EXT "#+"
+
+/* Longest secret file extension stored in the image, including the '.' */
+#define MAX_EXTN_SIZE 10
+
+/* Secret data is read, encoded and written in chunks of this many bytes */
+#define SECRET_CHUNK_SIZE 4096
+
+/* Image bytes the memory mapped paths walk at a time, the pages behind them are released */
+#define TILE_SIZE (64 * 1024 * 1024)
+
 #endif
@@ -0,0 +1,164 @@
+// Header files
+#include <string.h>
+#include <stdint.h>
+#include "compress.h"
+#include "types.h"
+
+/* Shortest match worth a sequence */
+#define MIN_MATCH 4
+
+/* Hash of the 4 bytes at p */
+static uint32_t hash4(const unsigned char *p){
+
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return (v * 2654435761u) >> (32 - 14);
+}
+
+/* Write a length that didn't fit in its nibble */
+static unsigned char *put_length(unsigned char *op, size_t length){
+
+    while (length >= 255){
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+/* Compress one block, returns the compressed size, or 0 when it doesn't get smaller */
+size_t lz_compress_block(const char *in, size_t in_size, char *out, size_t out_capacity, uint32_t *hash_table){
+
+    const unsigned char *base = (const unsigned char *)in;
+    const unsigned char *ip = base, *anchor = base;
+    const unsigned char *end = base + in_size;
+    const unsigned char *match_limit = (in_size > MIN_MATCH) ? end - MIN_MATCH : base;
+    unsigned char *op = (unsigned char *)out;
+    unsigned char *op_end = op + out_capacity;
+
+    if (in_size > COMPRESS_BLOCK_SIZE || out_capacity < COMPRESS_BOUND(in_size)){
+        return 0;
+    }
+    memset(hash_table, 0xFF, COMPRESS_HASH_SIZE * sizeof(uint32_t));
+
+    while (ip < match_limit){
+
+        //Step 1 : Look up the last position with the same 4 bytes
+        uint32_t h = hash4(ip);
+        uint32_t candidate = hash_table[h];
+        hash_table[h] = (uint32_t)(ip - base);
+
+        if (candidate == UINT32_MAX || memcmp(base + candidate, ip, MIN_MATCH) != 0){
+            ip++;
+            continue;
+        }
+
+        //Step 2 : Extend the match as far as it goes
+        const unsigned char *ref = base + candidate;
+        size_t match = MIN_MATCH;
+        while (ip + match < end && ip[match] == ref[match]){
+            match++;
+        }
+
+        //Step 3 : Token, literals, offset and the rest of the match length
+        size_t literals = ip - anchor;
+        unsigned char *token = op++;
+        *token = (unsigned char)(((literals < 15 ? literals : 15) << 4) | (match - MIN_MATCH < 15 ? match - MIN_MATCH : 15));
+        if (literals >= 15){
+            op = put_length(op, literals - 15);
+        }
+        memcpy(op, anchor, literals);
+        op += literals;
+
+        uint16_t offset = (uint16_t)(ip - ref);
+        *op++ = offset & 0xFF;
+        *op++ = offset >> 8;
+        if (match - MIN_MATCH >= 15){
+            op = put_length(op, match - MIN_MATCH - 15);
+        }
+
+        ip += match;
+        anchor = ip;
+    }
+
+    //Step 4 : The last sequence carries the remaining literals
+    size_t literals = end - anchor;
+    *op++ = (unsigned char)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15){
+        op = put_length(op, literals - 15);
+    }
+    memcpy(op, anchor, literals);
+    op += literals;
+
+    size_t size = op - (unsigned char *)out;
+    return (op <= op_end && size < in_size) ? size : 0;
+}
+
+/* Read a length that didn't fit in its nibble */
+static Status get_length(const unsigned char **ip, const unsigned char *end, size_t *length){
+
+    unsigned char byte;
+    do{
+        if (*ip >= end){
+            return failure;
+        }
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return success;
+}
+
+/* Decompress one block into out, which holds out_capacity bytes */
+Status lz_decompress_block(const char *in, size_t in_size, char *out, size_t out_capacity, size_t *out_size){
+
+    const unsigned char *ip = (const unsigned char *)in;
+    const unsigned char *end = ip + in_size;
+    unsigned char *base = (unsigned char *)out;
+    unsigned char *op = base;
+    unsigned char *op_end = base + out_capacity;
+
+    while (ip < end){
+
+        //Step 1 : Token and literals
+        unsigned char token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && get_length(&ip, end, &literals) != success){
+            return failure;
+        }
+        if ((size_t)(end - ip) < literals || (size_t)(op_end - op) < literals){
+            return failure;
+        }
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        //Step 2 : The last sequence has no match
+        if (ip == end){
+            break;
+        }
+
+        //Step 3 : Offset and match, byte by byte since it may overlap itself
+        if (end - ip < 2){
+            return failure;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t match = token & 15;
+        if (match == 15 && get_length(&ip, end, &match) != success){
+            return failure;
+        }
+        match += MIN_MATCH;
+
+        if (offset == 0 || offset > (size_t)(op - base) || (size_t)(op_end - op) < match){
+            return failure;
+        }
+        const unsigned char *ref = op - offset;
+        for (size_t i = 0; i < match; i++){
+            op[i] = ref[i];
+        }
+        op += match;
+    }
+
+    *out_size = op - base;
+    return success;
+}
@@ -0,0 +1,34 @@
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+/*
+ * Small LZ77 block codec in the LZ4 style, for the optional compression of
+ * the secret (STEGO_FLAG_COMPRESSED). Blocks are compressed independently,
+ * so a stream only needs one block of memory at a time. A sequence is :
+ *     token (literal length << 4 | match length - 4) | more literal length |
+ *     literals | match offset (16 bits) | more match length
+ * where a length nibble of 15 goes on with bytes of 255 until a smaller one.
+ * The last sequence of a block has literals only.
+ */
+
+/* Header Files */
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/* Uncompressed bytes per block, offsets stay below 64 KiB */
+#define COMPRESS_BLOCK_SIZE (64 * 1024)
+
+/* Largest compressed size of an n byte block */
+#define COMPRESS_BOUND(n) ((n) + (n) / 255 + 16)
+
+/* Entries of the match finder hash table the caller provides */
+#define COMPRESS_HASH_SIZE (1 << 14)
+
+/* Compress one block, returns the compressed size, or 0 when it doesn't get smaller */
+size_t lz_compress_block(const char *in, size_t in_size, char *out, size_t out_capacity, uint32_t *hash_table);
+
+/* Decompress one block into out, which holds out_capacity bytes */
+Status lz_decompress_block(const char *in, size_t in_size, char *out, size_t out_capacity, size_t *out_size);
+
+#endif
@@ -0,0 +1,345 @@
+// Header files
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "daemon.h"
+#include "encode.h"
+#include "decode.h"
+#include "lsb.h"
+#include "arena.h"
+#include "stats.h"
+#include "types.h"
+
+/* State of one worker, the request buffer is allocated once and reused */
+typedef struct DaemonWorker
+{
+    int listen_fd;
+    int id;
+    DaemonRequest *request;
+    Arena arena;         // Memory of the current job, reset between jobs
+} DaemonWorker;
+
+/* Descriptors are used through /proc/self/fd, so the mmap encoder/decoder take them as file names */
+static void fd_path(char *path, size_t size, int fd){
+
+    snprintf(path, size, "/proc/self/fd/%d", fd);
+}
+
+/* Run a request with the memory mapped encoder/decoder */
+static Status run_daemon_job(DaemonRequest *request, const int *fds, Arena *arena){
+
+    char paths[3][32];
+    char *argv[6] = { "daemon", NULL, request->args[0], request->args[1], request->args[2], NULL };
+
+    //Step 1 : Paths are validated like on the command line, descriptors stand in for the names
+    for (int i = 0; i < request->nfds; i++){
+        fd_path(paths[i], sizeof(paths[i]), fds[i]);
+    }
+
+    if (request->type == e_encode){
+        EncodeInfo enc_info = {0};
+        argv[1] = "-e";
+        if (request->nfds == 0){
+            if (read_and_validate_encode_args(argv, &enc_info) != success){
+                return failure;
+            }
+        }
+        else{
+            enc_info.src_image_fname = paths[0];
+            enc_info.secret_fname = paths[1];
+            enc_info.stego_image_fname = paths[2];
+            get_secret_file_extn(request->args[1], enc_info.extn_secret_file);
+        }
+        enc_info.threads = 1;
+        enc_info.quiet = 1;
+        enc_info.bits = request->bits;
+        enc_info.compress = request->compress;
+        enc_info.arena = arena;
+        return do_encoding_mmap(&enc_info);
+    }
+    else{
+        DecodeInfo dec_info = {0};
+        argv[1] = "-d";
+        if (request->nfds == 0){
+            if (read_and_validate_decode_args(argv, &dec_info) != success){
+                return failure;
+            }
+        }
+        else{
+            dec_info.stego_image_fname = paths[0];
+            dec_info.secret_fname = paths[1];
+        }
+        dec_info.threads = 1;
+        dec_info.quiet = 1;
+        dec_info.arena = arena;
+        return do_decoding_mmap(&dec_info);
+    }
+}
+
+/* Receive a request and the descriptors passed with it, returns the descriptor count or -1 */
+static int receive_request(int conn, DaemonRequest *request, int *fds){
+
+    char control[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov = { request, sizeof(*request) };
+    struct msghdr msg = {0};
+    int nfds = 0;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t n = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC);
+    if (n <= 0){
+        return -1;
+    }
+
+    //Step 1 : Take the descriptors first, so that none leaks on a bad request
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS){
+            int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (int i = 0; i < count && nfds < 3; i++){
+                memcpy(&fds[nfds++], CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            }
+        }
+    }
+
+    //Step 2 : Validate the request
+    if ((size_t)n != sizeof(*request) || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+        request->magic != DAEMON_MAGIC || request->version != DAEMON_VERSION ||
+        (request->type != e_encode && request->type != e_decode) || request->nfds != nfds ||
+        (nfds != 0 && nfds != (request->type == e_encode ? 3 : 2)) ||
+        request->bits < 0 || request->bits > LSB_MAX_BITS){
+        for (int i = 0; i < nfds; i++){
+            close(fds[i]);
+        }
+        return -1;
+    }
+    for (int i = 0; i < 3; i++){
+        request->args[i][DAEMON_MAX_PATH - 1] = '\0';
+    }
+
+    return nfds;
+}
+
+/* Serve the jobs of one connection until the client closes it */
+static void serve_connection(DaemonWorker *worker, int conn){
+
+    DaemonRequest *request = worker->request;
+    int fds[3];
+    int nfds;
+
+    while ((nfds = receive_request(conn, request, fds)) >= 0){
+
+        double start = stats_now();
+        DaemonReply reply = { DAEMON_MAGIC, failure, 0 };
+        reply.status = run_daemon_job(request, fds, &worker->arena);
+        reply.seconds = stats_now() - start;
+        arena_reset(&worker->arena);
+
+        for (int i = 0; i < nfds; i++){
+            close(fds[i]);
+        }
+        printf("%-6s worker %-3d %s %9.3f ms  %s\n", reply.status == success ? "OK" : "FAILED", worker->id,
+               request->type == e_encode ? "-e" : "-d", reply.seconds * 1e3, request->args[0]);
+
+        if (send(conn, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)){
+            break;
+        }
+    }
+    close(conn);
+}
+
+static void *daemon_worker(void *arg){
+
+    DaemonWorker *worker = arg;
+
+    arena_init(&worker->arena, ARENA_DEFAULT_SIZE);
+
+    // Every worker waits in accept, the kernel hands each connection to one of them
+    for (;;){
+        int conn = accept4(worker->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0){
+            continue;
+        }
+        serve_connection(worker, conn);
+    }
+    return NULL;
+}
+
+/* Listen on socket_path and serve jobs on threads workers until SIGINT / SIGTERM */
+Status do_daemon(const char *socket_path, int threads){
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    //Step 1 : The signals are taken by this thread only, the workers inherit the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    //Step 2 : Listening socket
+    if (strlen(socket_path) >= sizeof(addr.sun_path)){
+        printf("ERROR : Socket path %s is too long\n", socket_path);
+        return failure;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0){
+        perror("socket");
+        return failure;
+    }
+    unlink(socket_path);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, DAEMON_BACKLOG) != 0){
+        perror("bind");
+        fprintf(stderr, "ERROR : Unable to listen on %s\n", socket_path);
+        close(listen_fd);
+        return failure;
+    }
+
+    //Step 3 : Warm workers, the LSB kernels are picked once up front
+    if (threads <= 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? cpus : 1;
+    }
+    DaemonWorker workers[threads];
+    pthread_t tid;
+    int started = 0;
+    printf("INFO : Listening on %s with %d workers, %s kernels\n", socket_path, threads, lsb_kernel_name());
+
+    for (int w = 0; w < threads; w++){
+        workers[w] = (DaemonWorker){ listen_fd, w, malloc(sizeof(DaemonRequest)), {0} };
+        if (workers[w].request == NULL || pthread_create(&tid, NULL, daemon_worker, &workers[w]) != 0){
+            free(workers[w].request);
+            break;
+        }
+        pthread_detach(tid);
+        started++;
+    }
+    if (started == 0){
+        printf("ERROR : Unable to start the workers\n");
+        close(listen_fd);
+        unlink(socket_path);
+        return failure;
+    }
+    fflush(stdout);
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    //Step 4 : Wait for the signal, then remove the socket. The workers end with the process
+    int sig;
+    sigwait(&signals, &sig);
+    printf("INFO : Stopping on signal %d\n", sig);
+    close(listen_fd);
+    unlink(socket_path);
+
+    return success;
+}
+
+/* Run one job in the daemon, fails when the daemon can't be reached (the job status is in job_status) */
+Status daemon_submit(const char *socket_path, OperationType type, char *args[3], int bits, int compress, Status *job_status){
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    int nargs = (type == e_encode) ? 3 : 2;
+    int fds[3];
+    int nfds = 0;
+    Status status = success;
+    char tmp_fname[4096];
+
+    // The output is written next to its final name and only moved over it when the job succeeds
+    if (strlen(socket_path) >= sizeof(addr.sun_path) ||
+        (size_t)snprintf(tmp_fname, sizeof(tmp_fname), "%s.tmp", args[nargs - 1]) >= sizeof(tmp_fname)){
+        return failure;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    //Step 1 : Connect
+    int conn = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (conn < 0 || connect(conn, (struct sockaddr *)&addr, sizeof(addr)) != 0){
+        if (conn >= 0){
+            close(conn);
+        }
+        return failure;
+    }
+
+    //Step 2 : Open the files here, the output the way the encoder/decoder would but under its temporary name
+    for (int i = 0; i < nargs && status == success; i++){
+        int output = (i == nargs - 1);
+        const char *fname = output ? tmp_fname : args[i];
+        fds[i] = output ? open(fname, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : open(fname, O_RDONLY | O_CLOEXEC);
+        if (fds[i] < 0){
+            perror("open");
+            fprintf(stderr, "ERROR : Unable to open file %s\n", fname);
+            *job_status = failure;
+            status = failure;
+            break;
+        }
+        nfds++;
+    }
+
+    //Step 3 : Request with the descriptors
+    DaemonRequest *request = calloc(1, sizeof(DaemonRequest));
+    if (status == success && request != NULL){
+        char control[CMSG_SPACE(3 * sizeof(int))] = {0};
+        struct iovec iov = { request, sizeof(*request) };
+        struct msghdr msg = {0};
+
+        *request = (DaemonRequest){ DAEMON_MAGIC, DAEMON_VERSION, type, bits, compress, nfds, {{0}} };
+        for (int i = 0; i < nargs; i++){
+            snprintf(request->args[i], DAEMON_MAX_PATH, "%s", args[i]);
+        }
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+
+        //Step 4 : Wait for the reply
+        DaemonReply reply;
+        if (sendmsg(conn, &msg, MSG_NOSIGNAL) != sizeof(*request) ||
+            recv(conn, &reply, sizeof(reply), 0) != sizeof(reply) || reply.magic != DAEMON_MAGIC){
+            printf("ERROR : No reply from the daemon on %s\n", socket_path);
+            *job_status = failure;
+        }
+        else{
+            *job_status = reply.status;
+            printf("INFO : Done by the daemon in %.3f ms\n", reply.seconds * 1e3);
+        }
+    }
+    else if (request == NULL){
+        *job_status = failure;
+    }
+
+    for (int i = 0; i < nfds; i++){
+        close(fds[i]);
+    }
+    free(request);
+    close(conn);
+
+    //Step 5 : Keep the output only when the job succeeded, a file given as the output is left as it was otherwise
+    if (nfds == nargs){
+        if (*job_status == success && rename(tmp_fname, args[nargs - 1]) != 0){
+            perror("rename");
+            fprintf(stderr, "ERROR : Unable to write file %s\n", args[nargs - 1]);
+            *job_status = failure;
+        }
+        if (*job_status != success){
+            unlink(tmp_fname);
+        }
+    }
+
+    // The daemon was reached, the job status tells how the job went
+    return success;
+}
@@ -0,0 +1,53 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+/*
+ * Daemon mode : warm worker threads serve -e / -d jobs sent over a Unix
+ * domain socket (SOCK_SEQPACKET, one request and one reply per job).
+ * The files are given as paths, or opened by the client and passed as
+ * descriptors with SCM_RIGHTS so that relative paths and permissions are
+ * the client's own.
+ */
+
+/* Header Files */
+#include <stdint.h>
+#include "types.h"
+
+/* Longest path in a request */
+#define DAEMON_MAX_PATH 4096
+
+/* Pending connections the listening socket keeps */
+#define DAEMON_BACKLOG 128
+
+/* "LSBD" and the protocol version */
+#define DAEMON_MAGIC 0x4442534C
+#define DAEMON_VERSION 1
+
+/* One job, the args are the -e / -d arguments (carrier, secret, output / stego, output) */
+typedef struct DaemonRequest
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t type;                       // e_encode or e_decode
+    int32_t bits;                       // -k, 0 when not given
+    int32_t compress;                   // --compress
+    int32_t nfds;                       // Descriptors passed along, one per arg, 0 for paths
+    char args[3][DAEMON_MAX_PATH];      // Paths, or only the names when descriptors are passed
+} DaemonRequest;
+
+/* Result of a job */
+typedef struct DaemonReply
+{
+    uint32_t magic;
+    int32_t status;                     // Status of the job
+    double seconds;                     // Time the job took in the daemon
+} DaemonReply;
+
+/* Listen on socket_path and serve jobs on threads workers until SIGINT / SIGTERM */
+Status do_daemon(const char *socket_path, int threads);
+
+/* Run one job in the daemon, fails when the daemon can't be reached (the job status is in job_status).
+ * The output is written to <output>.tmp and renamed over the output only when the job succeeds */
+Status daemon_submit(const char *socket_path, OperationType type, char *args[3], int bits, int compress, Status *job_status);
+
+#endif
@@ -1,17 +1,24 @@
 // Header files
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "encode.h"
 #include "decode.h"
+#include "lsb.h"
+#include "stego.h"
+#include "stats.h"
 #include "types.h"
 #include "common.h"
+#include "stream.h"
 
 /* Read and validate Decode args from argv */
 Status read_and_validate_decode_args(char *argv[], DecodeInfo *decInfo)
 {
-    // Check if the input file is a .bmp file
-    char *result = strstr(argv[2], ".bmp");
-    if (result != NULL && strcmp(result, ".bmp") == 0){
+    // Check if the input file is a carrier file (.bmp, .ppm, .pgm, .pnm, .tga, .wav), "-" reads it from stdin
+    if (is_stream_name(argv[2]) || carrier_backend_for_name(argv[2]) != NULL){
         
         //If valid, store the name of the stego image into structure
         decInfo->stego_image_fname = argv[2];
@@ -30,7 +37,7 @@ Status read_and_validate_decode_args(char *argv[], DecodeInfo *decInfo)
     }
     else{
         //Print the error messages
-        printf("ERROR : Input file is not a .bmp file\n");
+        printf("ERROR : Input file is not a carrier file (.bmp, .ppm, .pgm, .pnm, .tga, .wav)\n");
         return failure;
     }
 }
@@ -48,6 +55,13 @@ Status open_decode_files(DecodeInfo *decInfo)
         return failure;
     }
 
+    //Parse the header once, it gives the start of the pixel array. A WAV file is only streamed
+    if (carrier_read_header(decInfo->fptr_stego_image, &decInfo->stego_carrier) != success || decInfo->stego_carrier.sample_size > 1){
+        printf("ERROR : Not an uncompressed BMP, PPM, PGM or TGA image\n");
+        fclose(decInfo->fptr_stego_image);
+        return failure;
+    }
+
     //if not equal to null, return the success
     return success;
 }
@@ -62,8 +76,8 @@ Status decode_magic_string(const char *magic_string, DecodeInfo *decInfo){
     //Declaration of char array with size of magic string plus 1
     char decoded_magic_string[strlen(magic_string) + 1]; 
 
-    // Move to 54th byte (image data starts here)
-    fseek(decInfo->fptr_stego_image, 54, SEEK_SET);
+    // Move to the pixel array (image data starts here)
+    fseek(decInfo->fptr_stego_image, decInfo->stego_carrier.pixel_offset, SEEK_SET);
 
     // Read the 8 bytes of characters one by one from stego image
     for (int i = 0; i < strlen(magic_string) ; i++)
@@ -83,6 +97,12 @@ Status decode_magic_string(const char *magic_string, DecodeInfo *decInfo){
     // Add the null character at the end of the array
     decoded_magic_string[strlen(magic_string)] = '\0';
 
+    // The extended format (k-LSB, flags) is decoded by the mmap decoder
+    decInfo->extended_format = (strcmp(decoded_magic_string, MAGIC_STRING_EXT) == 0);
+    if (decInfo->extended_format){
+        return success;
+    }
+
     // Check if the decoded string matches the expected magic string
     if (strcmp(decoded_magic_string, magic_string) != 0){
         printf("ERROR : This file doesn't contain any secret data (not a stego file)\n");
@@ -98,7 +118,7 @@ Status decode_secret_file_extn_size(DecodeInfo *decInfo){
 
     // Declaration of the character array
     char buffer[32];
-    int size;
+    size_t size;
 
     // Read the 32 bytes of characters from stego image
     //While reading, if error is occured, then return failure
@@ -109,10 +129,10 @@ Status decode_secret_file_extn_size(DecodeInfo *decInfo){
     // Decode the extension size
     decode_size_from_lsb(&size, buffer);
 
-    // Validate the size
-    if (size <= 0 || size > 4)
+    // Validate the size, 0 means the secret file had no extension
+    if (size > MAX_EXTN_SIZE)
     {
-        printf("ERROR : Invalid secret file extension size: %d\n", size);
+        printf("ERROR : Invalid secret file extension size: %zu\n", size);
         return failure;
     }
 
@@ -148,11 +168,7 @@ Status decode_secret_file_extn(DecodeInfo *decInfo){
     decInfo->extn_secret_file[decInfo->extn_size] = '\0';
 
     // Set default secret file name if not provided
-    if (decInfo->secret_fname == NULL){
-        static char default_name[50];
-        sprintf(default_name, "decoded_file%s", decInfo->extn_secret_file);
-        decInfo->secret_fname = default_name;
-    }
+    set_default_secret_fname(decInfo);
 
     decInfo->fptr_secret = fopen(decInfo->secret_fname, "w");
     if (decInfo->fptr_secret == NULL){
@@ -164,12 +180,21 @@ Status decode_secret_file_extn(DecodeInfo *decInfo){
     return success;
 }
 
+/* Use decoded_file<extn> when no output file name is given */
+void set_default_secret_fname(DecodeInfo *decInfo){
+
+    if (decInfo->secret_fname == NULL){
+        snprintf(decInfo->default_secret_fname, sizeof(decInfo->default_secret_fname), "decoded_file%s", decInfo->extn_secret_file);
+        decInfo->secret_fname = decInfo->default_secret_fname;
+    }
+}
+
 /* Decode Secret File Size */
 Status decode_secret_file_size(DecodeInfo *decInfo){
 
     //Declaration
     char buffer[32];
-    int file_size;
+    size_t file_size;
 
     // Read the 32 bytes of characters from stego image and While reading, if error is occured, then return failure
     if (fread(buffer, 32, 1, decInfo->fptr_stego_image) != 1){
@@ -181,7 +206,7 @@ Status decode_secret_file_size(DecodeInfo *decInfo){
     decInfo->size_secret_file = file_size;
 
     // Validate the size of the file
-    if (decInfo->size_secret_file <= 0){
+    if (decInfo->size_secret_file == 0 || decInfo->size_secret_file > STEGO_MAX_FIELD_SIZE){
 
         //Print the error message
         printf("ERROR : Decoded secret file size is invalid");
@@ -191,25 +216,32 @@ Status decode_secret_file_size(DecodeInfo *decInfo){
     return success;
 }
 
-/* Decode Secret File Data */
+/* Decode Secret File Data, one chunk at a time */
 Status decode_secret_file_data(DecodeInfo *decInfo){
 
     //Declaration
-    char buffer[8];
-    char decoded_char;
+    char buffer[SECRET_CHUNK_SIZE * 8];
+    char decoded_data[SECRET_CHUNK_SIZE];
+    size_t remaining = decInfo->size_secret_file;
 
-    for (int i = 0; i < decInfo->size_secret_file; i++)
+    while (remaining > 0)
     {
-        //Read the 8 bytes of data from stego image
-        if (fread(buffer, 8, 1, decInfo->fptr_stego_image) != 1){
+        size_t chunk = remaining < SECRET_CHUNK_SIZE ? remaining : SECRET_CHUNK_SIZE;
+
+        //Read the 8 bytes per secret byte from stego image
+        if (fread(buffer, chunk * 8, 1, decInfo->fptr_stego_image) != 1){
             return failure;
         }
 
         //Perform the decode operation
-        decode_byte_from_lsb(&decoded_char, buffer);
+        decode_data_from_lsb(decoded_data, chunk, buffer);
+
+        //Write the decoded chunk into secret file
+        if (fwrite(decoded_data, chunk, 1, decInfo->fptr_secret) != 1){
+            return failure;
+        }
 
-        //Write the 1 bytes of data into secret file
-        fwrite(&decoded_char, 1, 1, decInfo->fptr_secret);
+        remaining -= chunk;
     }
 
     return success;
@@ -229,15 +261,14 @@ Status decode_byte_from_lsb(char *data, char *image_buffer){
 }
 
 /* Decode size (4 bytes / 32 bits) from LSB */
-Status decode_size_from_lsb(int *data, char *image_buffer){
+Status decode_size_from_lsb(size_t *data, char *image_buffer){
 
-    //Initialization
-    *data = 0;
+    //Decode the 4 bytes, little endian, with the bulk kernel
+    unsigned char bytes[4];
+    decode_data_from_lsb((char *)bytes, 4, image_buffer);
 
-    //Performing the decode operation
-    for (int i = 0; i < 32; i++){
-        *data |= ((image_buffer[i] & 1) << i);
-    }
+    //Join the bytes into the size
+    *data = (size_t)bytes[0] | ((size_t)bytes[1] << 8) | ((size_t)bytes[2] << 16) | ((size_t)bytes[3] << 24);
     return success;
 }
 
@@ -245,6 +276,7 @@ Status decode_size_from_lsb(int *data, char *image_buffer){
 Status do_decoding(DecodeInfo *decInfo)
 {
     // Step 1 : Open the file
+    stats_stage(decInfo->stats, "open");
     if (open_decode_files(decInfo) != success){
         printf("ERROR : Unable to open the stego file\n");
         return failure;
@@ -252,13 +284,21 @@ Status do_decoding(DecodeInfo *decInfo)
     printf("INFO : Files opened successfully\n");
 
     // Step 2 : Decode magic string
+    stats_stage(decInfo->stats, "magic");
     if (decode_magic_string(MAGIC_STRING, decInfo) != success){
         printf("ERROR: Magic string mismatch\n");
         return failure;
     }
     printf("INFO : Magic string decoded successfully\n");
 
+    if (decInfo->extended_format){
+        printf("INFO : Extended format, decoding it with the mmap decoder\n");
+        fclose(decInfo->fptr_stego_image);
+        return do_decoding_mmap(decInfo);
+    }
+
     // Step 3 : Decode secret file extension size
+    stats_stage(decInfo->stats, "extn_size");
     if (decode_secret_file_extn_size(decInfo) != success){
         printf("ERROR: Failed to decode extension size\n");
         return failure;
@@ -266,6 +306,7 @@ Status do_decoding(DecodeInfo *decInfo)
     printf("INFO : Secret file extension size decoded successfully\n");
 
     // Step 4 : Decode secret file extension
+    stats_stage(decInfo->stats, "extn");
     if (decode_secret_file_extn(decInfo) != success){
         printf("ERROR : Failed to decode file extension\n");
         return failure;
@@ -273,6 +314,7 @@ Status do_decoding(DecodeInfo *decInfo)
     printf("INFO : Secret file extension decoded successfully\n");
 
     // Step 5 : Decode secret file size
+    stats_stage(decInfo->stats, "size");
     if (decode_secret_file_size(decInfo) != success){
         printf("ERROR : Failed to decode secret file size\n");
         return failure;
@@ -280,6 +322,7 @@ Status do_decoding(DecodeInfo *decInfo)
     printf("INFO : Secret file size decoded successfully\n");
 
     // Step 6 : Decode secret file data
+    stats_stage(decInfo->stats, "data");
     if (decode_secret_file_data(decInfo) != success){
         printf("ERROR: Failed to decode secret file data\n");
         return failure;
@@ -287,6 +330,7 @@ Status do_decoding(DecodeInfo *decInfo)
     printf("INFO : Secret file data successfully extracted to %s\n", decInfo->secret_fname);
 
     // Step 7 : Close all opened files
+    stats_stage(decInfo->stats, "close");
     fclose(decInfo->fptr_stego_image);
     fclose(decInfo->fptr_secret);
 
@@ -294,3 +338,208 @@ Status do_decoding(DecodeInfo *decInfo)
 
     return success;
 }
+
+
+/* Unmap all the mappings made by the mmap path */
+static void close_decode_files_mmap(DecodeInfo *decInfo){
+
+    if (decInfo->secret_map != NULL){
+        munmap(decInfo->secret_map, decInfo->size_secret_file);
+        decInfo->secret_map = NULL;
+    }
+    if (decInfo->stego_map != NULL){
+        munmap((void *)decInfo->stego_map, decInfo->stego_map_size);
+        decInfo->stego_map = NULL;
+    }
+}
+
+/* Map the stego image read only */
+static Status open_decode_files_mmap(DecodeInfo *decInfo){
+
+    decInfo->stego_map = NULL;
+    decInfo->secret_map = NULL;
+
+    int fd = open(decInfo->stego_image_fname, O_RDONLY);
+    if (fd < 0){
+        perror("open");
+        fprintf(stderr, "ERROR : Unable to open file %s\n", decInfo->stego_image_fname);
+        return failure;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0){
+        fprintf(stderr, "ERROR : Unable to find the size of %s\n", decInfo->stego_image_fname);
+        close(fd);
+        return failure;
+    }
+    decInfo->stego_map_size = st.st_size;
+
+    void *addr = mmap(NULL, decInfo->stego_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED){
+        perror("mmap");
+        return failure;
+    }
+    decInfo->stego_map = addr;
+
+    return success;
+}
+
+/* Create the output file at its final size and map it writable */
+static Status create_secret_file_mmap(DecodeInfo *decInfo){
+
+    int fd = open(decInfo->secret_fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0){
+        perror("open");
+        fprintf(stderr, "ERROR : Unable to open file %s for writing\n", decInfo->secret_fname);
+        return failure;
+    }
+
+    if (ftruncate(fd, decInfo->size_secret_file) != 0){
+        perror("ftruncate");
+        close(fd);
+        unlink(decInfo->secret_fname);
+        return failure;
+    }
+
+    void *addr = mmap(NULL, decInfo->size_secret_file, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED){
+        perror("mmap");
+        unlink(decInfo->secret_fname);
+        return failure;
+    }
+    decInfo->secret_map = addr;
+
+    return success;
+}
+
+/* Extract a secret laid out in the order of the pixels (flat or chunked) one tile at a time, from
+ * byte start on, releasing the written pages and, flat, the pixel pages read, so memory stays bounded */
+static Status extract_tiled(DecodeInfo *decInfo, const char *pixels, size_t pixels_size, const StegoHeader *header, size_t start){
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t tile = (size_t)TILE_SIZE / 8 * header->bits;
+    size_t data_start = decInfo->stego_carrier.pixel_offset + stego_header_size(header);
+    size_t released = 0, pixels_released = 0;
+
+    for (size_t done = 0; done < decInfo->size_secret_file; ){
+        size_t length = decInfo->size_secret_file - done > tile ? tile : decInfo->size_secret_file - done;
+        if (stego_extract_range(pixels, pixels_size, header, decInfo->secret_map + done, start + done, length, decInfo->threads) != success){
+            return failure;
+        }
+        done += length;
+
+        if (done / page * page > released){
+            madvise(decInfo->secret_map + released, done / page * page - released, MADV_DONTNEED);
+            released = done / page * page;
+        }
+        size_t consumed = (data_start + (start + done) / header->bits * 8) / page * page;
+        if (!(header->flags & STEGO_FLAG_CHUNKED) && consumed > pixels_released){
+            madvise((char *)decInfo->stego_map + pixels_released, consumed - pixels_released, MADV_DONTNEED);
+            pixels_released = consumed;
+        }
+    }
+
+    return success;
+}
+
+/* Perform decoding directly over the mapped files, without any fread/fwrite */
+Status do_decoding_mmap(DecodeInfo *decInfo)
+{
+    StegoHeader header;
+
+    // Step 1 : Map the stego image
+    stats_stage(decInfo->stats, "open");
+    if (open_decode_files_mmap(decInfo) != success){
+        printf("ERROR : Unable to map the stego file\n");
+        return failure;
+    }
+    if(!decInfo->quiet) printf("INFO : Files mapped successfully\n");
+
+    if (carrier_parse_header(decInfo->stego_map, decInfo->stego_map_size, &decInfo->stego_carrier) != success || decInfo->stego_carrier.sample_size > 1){
+        printf("ERROR : Not an uncompressed BMP, PPM, PGM or TGA image\n");
+        close_decode_files_mmap(decInfo);
+        return failure;
+    }
+    size_t pixels_size;
+    const char *pixels = carrier_pixels(&decInfo->stego_carrier, decInfo->stego_map, decInfo->stego_map_size, &pixels_size);
+
+    // Step 2 : Decode the magic string, extension and size, all bounded by the mapped image
+    stats_stage(decInfo->stats, "header");
+    memset(&header, 0, sizeof(header));
+    memcpy(header.key, decInfo->key, sizeof(header.key));
+    if (stego_read_header(pixels, pixels_size, &header) != success){
+        printf("ERROR : This file doesn't contain any secret data (not a stego file)\n");
+        close_decode_files_mmap(decInfo);
+        return failure;
+    }
+    if ((header.flags & STEGO_FLAG_SCATTERED) && header.key[0] == 0 && header.key[1] == 0){
+        printf("ERROR : The secret data is scattered, it needs the --key it was embedded with\n");
+        close_decode_files_mmap(decInfo);
+        return failure;
+    }
+    if (header.flags & STEGO_FLAG_STRIPED){
+        printf("ERROR : This file holds part %zu of %zu of a striped secret, use join\n", header.stripe.index, header.stripe.count);
+        close_decode_files_mmap(decInfo);
+        return failure;
+    }
+    if(!decInfo->quiet) printf("INFO : Magic string, extension and size decoded successfully (%d bits per channel)\n", header.bits);
+
+    strcpy(decInfo->extn_secret_file, header.extn);
+    decInfo->extn_size = strlen(header.extn);
+    decInfo->size_secret_file = header.original_size;
+    set_default_secret_fname(decInfo);
+
+    if (decInfo->size_secret_file == 0){
+        printf("ERROR : Decoded secret file size is invalid\n");
+        close_decode_files_mmap(decInfo);
+        return failure;
+    }
+
+    // A range of the secret, only its chunks or its pixel bytes are read
+    if (decInfo->range){
+        if (header.flags & STEGO_FLAG_COMPRESSED){
+            printf("ERROR : --range can't be used on a compressed secret\n");
+            close_decode_files_mmap(decInfo);
+            return failure;
+        }
+        if (decInfo->range_end > header.original_size){
+            printf("ERROR : --range goes past the end of the secret of %zu bytes\n", header.original_size);
+            close_decode_files_mmap(decInfo);
+            return failure;
+        }
+        decInfo->size_secret_file = decInfo->range_end - decInfo->range_start;
+    }
+
+    // Step 3 : Create the output at its final size and decode straight into it
+    stats_stage(decInfo->stats, "extract");
+    if (create_secret_file_mmap(decInfo) != success){
+        close_decode_files_mmap(decInfo);
+        return failure;
+    }
+    void *scratch = decInfo->arena ? arena_alloc(decInfo->arena, STEGO_SCRATCH_SIZE) : NULL;
+    Status extracted;
+    if ((header.flags & ~(STEGO_FLAG_WIDE | STEGO_FLAG_CHUNKED)) == 0){
+        extracted = extract_tiled(decInfo, pixels, pixels_size, &header, decInfo->range ? decInfo->range_start : 0);
+    }
+    else{
+        extracted = decInfo->range ? stego_extract_range(pixels, pixels_size, &header, decInfo->secret_map, decInfo->range_start,
+                                                         decInfo->size_secret_file, decInfo->threads)
+                                   : stego_extract(pixels, pixels_size, &header, decInfo->secret_map, decInfo->threads, scratch);
+    }
+    if (extracted != success){
+        printf("ERROR : Unable to extract the secret data, it is corrupted\n");
+        close_decode_files_mmap(decInfo);
+        unlink(decInfo->secret_fname);
+        return failure;
+    }
+    if(!decInfo->quiet && (header.flags & STEGO_FLAG_COMPRESSED)) printf("INFO : Secret data decompressed from %zu to %zu bytes\n", header.secret_size, header.original_size);
+    if(!decInfo->quiet) printf("INFO : Secret file data successfully extracted to %s\n", decInfo->secret_fname);
+
+    // Step 4 : Unmap the files
+    stats_stage(decInfo->stats, "unmap");
+    close_decode_files_mmap(decInfo);
+
+    return success;
+}
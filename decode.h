@@ -5,6 +5,9 @@
 #include "encode.h"
 #include "stdio.h"
 #include "types.h"
+#include "common.h"
+#include "carrier.h"
+#include "stats.h"
 
 // Decode Info structure
 typedef struct DecodeInfo
@@ -12,14 +15,30 @@ typedef struct DecodeInfo
     /* Stego image section */
     char *stego_image_fname;
     FILE *fptr_stego_image;
+    CarrierInfo stego_carrier;   // Header of the stego image, parsed once
 
 
     /* Secret file names*/
     char *secret_fname;
+    char default_secret_fname[MAX_EXTN_SIZE + 16]; // decoded_file<extn> when no name is given
     FILE *fptr_secret;
     int extn_size;
-    char extn_secret_file[11];
-    long size_secret_file;
+    char extn_secret_file[MAX_EXTN_SIZE + 1];
+    size_t size_secret_file;
+
+    /* Memory mapped view (--mmap) */
+    const char *stego_map;   // Read only mapping of the stego image
+    size_t stego_map_size;   // Size of the stego image mapping
+    char *secret_map;        // Writable mapping of the output file
+    int threads;             // Threads used for the secret data (--threads)
+    uint64_t key[2];         // Scatter key (--key), zero for none
+    int range;               // Extract only bytes [range_start, range_end) of the secret (--range)
+    size_t range_start;
+    size_t range_end;
+    int quiet;               // Only print the errors (batch jobs)
+    int extended_format;     // MAGIC_STRING_EXT found, the stdio decoder hands over to the mmap one
+    StegoStats *stats;       // Per stage counters (--stats), NULL when off
+    Arena *arena;            // Job memory of a batch/daemon worker, NULL to use malloc
 
 } DecodeInfo;
 
@@ -54,6 +73,12 @@ Status decode_secret_file_data(DecodeInfo *decInfo);
 Status decode_byte_from_lsb(char *data, char *image_buffer);
 
 /* Decode size from LSB of image data */
-Status decode_size_from_lsb(int *data, char *image_buffer);
+Status decode_size_from_lsb(size_t *data, char *image_buffer);
+
+/* Use decoded_file<extn> when no output file name is given */
+void set_default_secret_fname(DecodeInfo *decInfo);
+
+/* Perform the decoding over memory mapped files */
+Status do_decoding_mmap(DecodeInfo *decInfo);
 
 #endif
\ No newline at end of file
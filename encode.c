@@ -1,55 +1,79 @@
 //Header files
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
 #include "encode.h"
+#include "lsb.h"
+#include "stego.h"
+#include "stats.h"
 #include "types.h"
 #include "common.h"
+#include "stream.h"
+
+/* Output name when none is given, with the extension of the source since the stego image keeps its format */
+static char *default_stego_fname(const char *src_fname){
+
+    static char *const names[] = { "default.bmp", "default.ppm", "default.pgm", "default.pnm", "default.tga", "default.wav" };
+    const char *dot = strrchr(src_fname, '.');
+
+    for(size_t i = 0; dot != NULL && i < sizeof(names) / sizeof(names[0]); i++){
+        if(strcasecmp(names[i] + strlen("default"), dot) == 0){
+            return names[i];
+        }
+    }
+    return names[0];
+}
 
 /* Validate the source file */
 Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo){
 
-    //Step 1 : Check the extension of source file is .bmp or not
-    char *result = strstr(argv[2], ".bmp");
-    if(result != NULL && strcmp(result, ".bmp") == 0){
+    //Step 1 : Check the extension of source file is one of a carrier format (.bmp, .ppm, .pgm, .pnm, .tga, .wav), "-" reads it from stdin
+    const CarrierBackend *backend = carrier_backend_for_name(argv[2]);
+    if(is_stream_name(argv[2]) || backend != NULL){
 
         encInfo->src_image_fname = argv[2];
 
-        //Step 2 : Check the extension of secret file, it might be .h, .c, .sh and .txt
-        result = strstr(argv[3], ".");
+        //Step 2 : Any secret file is accepted, the extension is only kept to name the decoded file
+        encInfo->secret_fname = argv[3];
+        get_secret_file_extn(encInfo->secret_fname, encInfo->extn_secret_file);
 
-        if (result != NULL && (strcmp(result, ".h") == 0 || strcmp(result, ".c") == 0 || strcmp(result, ".sh") == 0 || strcmp(result, ".txt") == 0)){
+        //Step 3 : The output is a copy of the source, so its extension has to be one of the same format. This file don't need to exist, if not given create a default one
+        if(argv[4] != NULL){
+
+            const CarrierBackend *output = carrier_backend_for_name(argv[4]);
             
-            //If valid, store the argv[3] into structure
-            encInfo->secret_fname = argv[3];
-
-            //Step 3 : Check the extension of output file is .bmp, this file don't need to exist, if not exist and create default one .bmp file
-            if(argv[4] != NULL){
-
-                result = strstr(argv[4], ".bmp");
-                
-                if(result != NULL && strcmp(result, ".bmp") == 0){
-
-                    //If valid, store the argv[4] into structure
-                    encInfo->stego_image_fname = argv[4];
-                    return success;
-                }
-                else{
-                    printf("ERROR : Output file is not a .bmp file\n");
-                    return failure;
-                }
-            }
-            else {
-                encInfo->stego_image_fname = "default.bmp";
+            if(is_stream_name(argv[4]) || (output != NULL && (backend == NULL || output == backend))){
+
+                //If valid, store the argv[4] into structure
+                encInfo->stego_image_fname = argv[4];
                 return success;
             }
+            else if(output != NULL){
+                printf("ERROR : Output file has to be a %s file like the source\n", backend->name);
+                return failure;
+            }
+            else{
+                printf("ERROR : Output file is not a carrier file (.bmp, .ppm, .pgm, .pnm, .tga, .wav)\n");
+                return failure;
+            }
         }
-        else{
-            printf("ERROR : Unsupported secret file format\n");
-            return failure;
+        else {
+            encInfo->stego_image_fname = default_stego_fname(argv[2]);
+            return success;
         }
     } 
     else{
-        printf("ERROR : Source file is not a .bmp file\n");
+        printf("ERROR : Source file is not a carrier file (.bmp, .ppm, .pgm, .pnm, .tga, .wav)\n");
         return failure;
     }
 
@@ -57,6 +81,24 @@ Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo){
 
 }
 
+/* Store the extension of the secret file (last '.' of the file name), empty if it has none */
+Status get_secret_file_extn(const char *secret_fname, char *extn){
+
+    //Step 1 : Look only at the file name, not at the directories
+    const char *name = strrchr(secret_fname, '/');
+    name = (name != NULL) ? name + 1 : secret_fname;
+
+    //Step 2 : Find the last '.', a leading '.' is part of the name
+    const char *dot = strrchr(name, '.');
+    if(dot == NULL || dot == name || strlen(dot) > MAX_EXTN_SIZE){
+        extn[0] = '\0';
+        return failure;
+    }
+
+    strcpy(extn, dot);
+    return success;
+}
+
 /* Open the files */
 Status open_files(EncodeInfo *encInfo)
 {
@@ -99,27 +141,8 @@ Status open_files(EncodeInfo *encInfo)
     return success;
 }
 
-/* Get the size of the image */
-uint get_image_size_for_bmp(FILE *fptr_image)
-{
-    uint width, height;
-    // Seek to 18th byte
-    fseek(fptr_image, 18, SEEK_SET);
-
-    // Read the width (an int)
-    fread(&width, sizeof(int), 1, fptr_image);
-    printf("Width = %u\n", width);
-
-    // Read the height (an int)
-    fread(&height, sizeof(int), 1, fptr_image);
-    printf("Height = %u\n", height);
-
-    // Return image capacity
-    return width * height * 3;
-}
-
 /* Get the size of the file */
-uint get_file_size(FILE *fptr)
+size_t get_file_size(FILE *fptr)
 {
     
     if(fptr == NULL){
@@ -127,9 +150,10 @@ uint get_file_size(FILE *fptr)
         return 0;
     }
 
-    //Move the file pointer to end of the file
-    fseek(fptr, 0, SEEK_END);
-    return ftell(fptr);
+    //Move the file pointer to end of the file, off_t keeps files over 2 GB
+    fseeko(fptr, 0, SEEK_END);
+    off_t size = ftello(fptr);
+    return size > 0 ? (size_t)size : 0;
 }
 
 /*
@@ -137,14 +161,34 @@ uint get_file_size(FILE *fptr)
 */
 Status check_capacity(EncodeInfo *encInfo){
 
-    //Step 1 : Get the size of the image
-    encInfo->image_capacity = get_image_size_for_bmp(encInfo->fptr_src_image);
+    //Step 1 : Parse the header once and get the size of the pixel array, a WAV file is only streamed
+    if (carrier_read_header(encInfo->fptr_src_image, &encInfo->src_carrier) != success || encInfo->src_carrier.sample_size > 1){
+        printf("ERROR : Not an uncompressed BMP, PPM, PGM or TGA image\n");
+        return failure;
+    }
+    printf("Width = %d\n", encInfo->src_carrier.width);
+    printf("Height = %d\n", encInfo->src_carrier.height);
+    printf("Bits per pixel = %d\n", encInfo->src_carrier.bpp);
+
+    //Only the pixel bytes the file really holds can carry data
+    size_t image_file_size = get_file_size(encInfo->fptr_src_image);
+    if (encInfo->src_carrier.pixel_offset >= image_file_size){
+        printf("ERROR : The pixel array starts past the end of the image\n");
+        return failure;
+    }
+    encInfo->image_capacity = carrier_pixel_region(&encInfo->src_carrier, image_file_size);
 
     //Get the file size of the secret file
     encInfo->size_secret_file = get_file_size(encInfo->fptr_secret);
 
+    //The classic layout has 32 bit size fields, the extended one of the mmap path is needed past them
+    if(encInfo->size_secret_file > STEGO_MAX_FIELD_SIZE){
+        printf("ERROR : The secret is %zu bytes, over the 32 bit size field of the classic layout, use --mmap\n", encInfo->size_secret_file);
+        return failure;
+    }
+
     //Total bytes required for secret + metadata
-    uint total_required_bytes = (strlen(MAGIC_STRING) + sizeof(int) + strlen(encInfo->extn_secret_file) + sizeof(int) + encInfo->size_secret_file) * 8;
+    size_t total_required_bytes = (strlen(MAGIC_STRING) + sizeof(int) + strlen(encInfo->extn_secret_file) + sizeof(int) + encInfo->size_secret_file) * 8;
 
     if(encInfo->image_capacity > total_required_bytes){
         return success;
@@ -154,30 +198,36 @@ Status check_capacity(EncodeInfo *encInfo){
     }
 }
 
-/*  Following function is used to copy the header in source bmp file to destination bmp file, 
-    header have 54 bytes, so we have to copy that 54 bytes of data. Because they should not be changed at all*/
-Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image){
+/*  Following function is used to copy the header in source image to destination image,
+    header is everything before the pixel array (bfOffBits bytes for a BMP). Because they should not be changed at all.
+    The header size comes from the file, so it is copied in blocks of a fixed size*/
+Status copy_image_header(FILE *fptr_src_image, FILE *fptr_dest_image, size_t header_size){
 
-    //Declare the buffer with size of 54
-    char buffer[54];
+    //Declare the buffer with size of one block
+    char buffer[TAIL_COPY_BLOCK_SIZE];
 
     //Move the file pointer back to beginning of the source file 
     rewind(fptr_src_image);
 
-    //Step 1 : Read the header's data from source file into buffer
-    if(fread(buffer, 54, 1, fptr_src_image) != 1){
-        perror("ERROR : Reading the header content from file\n");
-        return failure;
-    };
+    for (size_t left = header_size; left > 0; ){
+        size_t n = left < sizeof(buffer) ? left : sizeof(buffer);
 
-    //Step 2 : write the data in buffer into destination file
-    if(fwrite(buffer, 54, 1, fptr_dest_image) != 1){
-        perror("ERROR : Writing the header content from file\n");
-        return failure;
+        //Step 1 : Read the header's data from source file into buffer
+        if(fread(buffer, n, 1, fptr_src_image) != 1){
+            perror("ERROR : Reading the header content from file\n");
+            return failure;
+        }
+
+        //Step 2 : write the data in buffer into destination file
+        if(fwrite(buffer, n, 1, fptr_dest_image) != 1){
+            perror("ERROR : Writing the header content from file\n");
+            return failure;
+        }
+        left -= n;
     }
 
     //Step 3 : Check the copy is done or not
-    //if both value is 54, it indicates we have done it, otherwise we haven't done
+    //if both value is header_size, it indicates we have done it, otherwise we haven't done
     if(ftell(fptr_src_image) == ftell(fptr_dest_image)){
         return success;
     }
@@ -270,7 +320,7 @@ Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo){
 }
 
 /* Encode the size of the secret file like 2 or 3 or 4 */
-Status encode_secret_file_size(long file_size, EncodeInfo *encInfo){
+Status encode_secret_file_size(size_t file_size, EncodeInfo *encInfo){
     
     //Declaration of the character array
     char buffer[32];
@@ -296,35 +346,42 @@ Status encode_secret_file_size(long file_size, EncodeInfo *encInfo){
 
 }
 
-/* Encode the extension name of the secret file data in the destination file */
+/* Encode the data of the secret file, one chunk at a time so memory stays bounded */
 Status encode_secret_file_data(EncodeInfo *encInfo){
 
     //Move the file pointer back to beginning of the source file 
     rewind(encInfo -> fptr_secret);
 
-    // Read the bytes based of size of secret file and store into the 
-    fread(encInfo -> secret_data , encInfo ->size_secret_file, 1, encInfo -> fptr_secret);
+    // Declaration of buffer for 8 image bytes per secret byte of a chunk
+    char buffer[SECRET_CHUNK_SIZE * 8];
+    size_t remaining = encInfo -> size_secret_file;
 
-    // Declaration of buffer with size of 8
-    char buffer[8];
+    // Run the loop until the whole secret file is encoded
+    while(remaining > 0){
 
-    // Run the loop based on size in the secret file
-    for(size_t i=0; i < encInfo -> size_secret_file; i++){
+            // Read the next chunk of the secret file
+            size_t chunk = remaining < SECRET_CHUNK_SIZE ? remaining : SECRET_CHUNK_SIZE;
+            if(fread(encInfo -> secret_data, chunk, 1, encInfo -> fptr_secret) != 1){
+                perror("ERROR : Read the data from secret file\n");
+                return failure;
+            }
 
-            // Read the 8 bytes data from the source file
-            if(fread(buffer,8,1, encInfo -> fptr_src_image) != 1){
+            // Read the 8 bytes per secret byte from the source file
+            if(fread(buffer, chunk * 8, 1, encInfo -> fptr_src_image) != 1){
                 perror("ERROR : Read the data from source file\n");
                 return failure;
             }
 
             // Perform the encode operation
-            encode_byte_to_lsb(encInfo -> secret_data[i] , buffer );
+            encode_data_to_lsb(encInfo -> secret_data, chunk, buffer);
 
-            // Write the encoded 8 bytes of data into the destination file
-            if(fwrite(buffer,8,1, encInfo -> fptr_stego_image) != 1){
+            // Write the encoded bytes into the destination file
+            if(fwrite(buffer, chunk * 8, 1, encInfo -> fptr_stego_image) != 1){
                 perror("ERROR : Write the data into the destination file\n");
                 return failure;
             }
+
+            remaining -= chunk;
     }
 
     //Return
@@ -332,21 +389,88 @@ Status encode_secret_file_data(EncodeInfo *encInfo){
 }
 
 
+/* Copy the tail inside the kernel, returns the bytes copied or -1 when not supported */
+static long copy_tail_in_kernel(int fd_src, long *off_src, int fd_dest, long *off_dest){
+
+#ifdef __linux__
+    long total = 0;
+    ssize_t n;
+
+    //Step 1 : copy_file_range, no data passes through user space (and it may reflink)
+    loff_t in = *off_src, out = *off_dest;
+    while ((n = copy_file_range(fd_src, &in, fd_dest, &out, TAIL_COPY_BLOCK_SIZE * 16, 0)) > 0){
+        total += n;
+    }
+    if (n == 0){
+        *off_src = in;
+        *off_dest = out;
+        return total;
+    }
+    if (total > 0 || (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP)){
+        return -1;
+    }
+
+    //Step 2 : sendfile, it needs the destination offset to be the file position
+    off_t in_off = *off_src;
+    if (lseek(fd_dest, *off_dest, SEEK_SET) < 0){
+        return -1;
+    }
+    while ((n = sendfile(fd_dest, fd_src, &in_off, TAIL_COPY_BLOCK_SIZE * 16)) > 0){
+        total += n;
+    }
+    if (n == 0){
+        *off_src = in_off;
+        *off_dest += total;
+        return total;
+    }
+#else
+    (void)fd_src; (void)off_src; (void)fd_dest; (void)off_dest;
+#endif
+    return -1;
+}
+
 /* Copy the remaining data in the souce image */
 Status copy_remaining_img_data(FILE *fptr_src, FILE *fptr_dest)
 {
-    //Declaration
-    char ch;
+    //Step 1 : Flush what stdio still holds, so the file offsets are the real ones
+    if (fflush(fptr_dest) != 0){
+        perror("ERROR : Writing to destination file\n");
+        return failure;
+    }
+    long off_src = ftell(fptr_src);
+    long off_dest = ftell(fptr_dest);
+
+    //Step 2 : Fast path, let the kernel move the untouched tail
+    if (off_src >= 0 && off_dest >= 0 &&
+        copy_tail_in_kernel(fileno(fptr_src), &off_src, fileno(fptr_dest), &off_dest) >= 0){
+
+        //Keep the stdio positions in line with what the kernel copied
+        fseek(fptr_src, off_src, SEEK_SET);
+        fseek(fptr_dest, off_dest, SEEK_SET);
+        return success;
+    }
+
+    //Step 3 : Fallback, copy large aligned blocks through stdio
+    fseek(fptr_src, off_src, SEEK_SET);
+    fseek(fptr_dest, off_dest, SEEK_SET);
+
+    void *block;
+    if (posix_memalign(&block, 4096, TAIL_COPY_BLOCK_SIZE) != 0){
+        printf("ERROR : Unable to allocate the copy buffer\n");
+        return failure;
+    }
 
-    //Read the content by one byte from source, then write that byte to destination file
-    while (fread(&ch, 1, 1, fptr_src) == 1){
-        if(fwrite(&ch, 1, 1, fptr_dest) != 1){
+    size_t n;
+    while ((n = fread(block, 1, TAIL_COPY_BLOCK_SIZE, fptr_src)) > 0){
+        if(fwrite(block, n, 1, fptr_dest) != 1){
             perror("ERROR : Writing to destination file\n");
+            free(block);
             return failure;
         }
     }
+    free(block);
 
-    //Check if loop was ended while reading the data byte by byte from source file
+    //Check if loop was ended while reading the data from source file
     if(ferror(fptr_src)){
         perror("ERROR : Reading from source file\n");
         return failure;
@@ -365,23 +489,27 @@ Status encode_byte_to_lsb(char data, char *image_buffer){
     for(int i = 0 ; i < 8 ; i++ ){
         image_buffer[i] = (image_buffer[i] & ~1) | ((data >> i) & 1 );
     }
-
+    return success;
 }
 
-/* For size */
-Status encode_size_to_lsb(int size, char *imageBuffer){
+/* For size, a 32 bit field */
+Status encode_size_to_lsb(size_t size, char *imageBuffer){
 
-    // Performing the encode operation
-    for(int i = 0 ; i < 32 ; i++ ){
-        imageBuffer[i] = (imageBuffer[i] & ~1) | ((size >> i) & 1 );
+    // Split the size into 4 bytes, little endian, so the bulk kernel puts bit i into imageBuffer[i]
+    char bytes[4];
+    for(int i = 0 ; i < 4 ; i++ ){
+        bytes[i] = (size >> (i * 8)) & 0xFF;
     }
 
+    // Performing the encode operation
+    return encode_data_to_lsb(bytes, 4, imageBuffer);
 }
 
 /* Following function perform the encoding operation by calling required function one by one */
 Status do_encoding(EncodeInfo *encInfo){
 
     //Step 1 : Open the required files
+    stats_stage(encInfo->stats, "open");
     if(open_files(encInfo) == success){
         printf("INFO : Files are opened sucessfully\n");
     }
@@ -391,6 +519,7 @@ Status do_encoding(EncodeInfo *encInfo){
     }
 
     //Step 2 : Check the capacity of the image
+    stats_stage(encInfo->stats, "capacity");
     if(check_capacity(encInfo) == success){
         printf("INFO : Image has enough capacity to encode the secret data into it\n");
     }
@@ -400,7 +529,8 @@ Status do_encoding(EncodeInfo *encInfo){
     }
 
     //Step 3 : Copy the Header content of the source file to destination file
-    if(copy_bmp_header(encInfo->fptr_src_image, encInfo->fptr_stego_image) == success){
+    stats_stage(encInfo->stats, "header");
+    if(copy_image_header(encInfo->fptr_src_image, encInfo->fptr_stego_image, encInfo->src_carrier.pixel_offset) == success){
         printf("INFO : Sucessfully copied the header content from source file to destination file\n");
     }
     else{
@@ -409,6 +539,7 @@ Status do_encoding(EncodeInfo *encInfo){
     }
 
     //Step 4 : Encode the magic string
+    stats_stage(encInfo->stats, "magic");
     if(encode_magic_string(MAGIC_STRING, encInfo) == success){
         printf("INFO : Sucessfully encode the magic string into the destional file\n");
     }
@@ -417,9 +548,9 @@ Status do_encoding(EncodeInfo *encInfo){
         return failure;
     }
 
-    //Step 5 : Find the extension size
-    //Declaration
-    char *ptr = strchr(encInfo->secret_fname, '.');
+    //Step 5 : Encode the extension size
+    stats_stage(encInfo->stats, "extn_size");
+    char *ptr = encInfo->extn_secret_file;
     if(encode_secret_file_extn_size(strlen(ptr), encInfo) == success){
         printf("INFO : Sucessfully encode the size of the extension name\n");
     }
@@ -428,6 +559,7 @@ Status do_encoding(EncodeInfo *encInfo){
     }
 
     //Step 6 : Call the function for encode the name of the file extension
+    stats_stage(encInfo->stats, "extn");
     if(encode_secret_file_extn(ptr, encInfo) == success){
         printf("INFO : Sucessfully encode the extension name\n");
     }
@@ -437,6 +569,7 @@ Status do_encoding(EncodeInfo *encInfo){
     }
 
     // Step 7: Encode secret file size
+    stats_stage(encInfo->stats, "size");
     if (encode_secret_file_size(encInfo->size_secret_file, encInfo) == success){
         printf("INFO : Size of the Secret file is successfully encoded\n");
     }
@@ -446,6 +579,7 @@ Status do_encoding(EncodeInfo *encInfo){
     }
 
     // Step 8: Encode secret file data
+    stats_stage(encInfo->stats, "data");
     if (encode_secret_file_data(encInfo) == success){
         printf("INFO : Data in secret file is sucessfully encoded\n");
     }
@@ -455,6 +589,7 @@ Status do_encoding(EncodeInfo *encInfo){
     }
 
     // Step 9: Copy remaining image bytes
+    stats_stage(encInfo->stats, "tail");
     if (copy_remaining_img_data(encInfo->fptr_src_image, encInfo->fptr_stego_image) == success){
         printf("INFO : Remaining image data copied successfully\n");
     }
@@ -467,3 +602,274 @@ Status do_encoding(EncodeInfo *encInfo){
     return success;
 }
 
+
+
+/* Map a whole file read only, size 0 files are not mapped */
+Status map_file_read_only(const char *fname, const char **map, size_t *size){
+
+    //Open the file and find the size of it
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0){
+        perror("open");
+        fprintf(stderr, "ERROR : Unable to open file %s\n", fname);
+        return failure;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0){
+        perror("fstat");
+        close(fd);
+        return failure;
+    }
+
+    *size = st.st_size;
+    *map = NULL;
+
+    //Map the file, the mapping stays valid after closing the descriptor
+    if (*size > 0){
+        void *addr = mmap(NULL, *size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED){
+            perror("mmap");
+            fprintf(stderr, "ERROR : Unable to map file %s\n", fname);
+            close(fd);
+            return failure;
+        }
+        *map = addr;
+    }
+
+    close(fd);
+    return success;
+}
+
+/* Map the source image and secret file, read only */
+Status open_files_mmap(EncodeInfo *encInfo){
+
+    size_t secret_size;
+
+    encInfo->src_map = NULL;
+    encInfo->secret_map = NULL;
+    encInfo->stego_map = NULL;
+
+    //Step 1 : Map the source image
+    if (map_file_read_only(encInfo->src_image_fname, &encInfo->src_map, &encInfo->src_map_size) == failure){
+        return failure;
+    }
+
+    //Step 2 : Map the secret file
+    if (map_file_read_only(encInfo->secret_fname, &encInfo->secret_map, &secret_size) == failure){
+        return failure;
+    }
+    encInfo->size_secret_file = secret_size;
+
+    return success;
+}
+
+/* Describe the secret for stego_embed */
+void fill_stego_header(const EncodeInfo *encInfo, StegoHeader *header){
+
+    memset(header, 0, sizeof(*header));
+    strcpy(header->extn, encInfo->extn_secret_file);
+    header->secret_size = encInfo->size_secret_file;
+    header->original_size = encInfo->size_secret_file;
+    header->bits = encInfo->bits ? encInfo->bits : 1;
+    header->flags = encInfo->compress ? STEGO_FLAG_COMPRESSED : 0;
+    if (encInfo->key[0] != 0 || encInfo->key[1] != 0){
+        header->flags |= STEGO_FLAG_SCATTERED;
+        memcpy(header->key, encInfo->key, sizeof(header->key));
+    }
+    if (encInfo->chunk_size > 0){
+        header->flags |= STEGO_FLAG_CHUNKED;
+        header->chunk_size = encInfo->chunk_size;
+    }
+    stego_fit_fields(header);
+}
+
+/* Check capacity using the mapped source image header */
+Status check_capacity_mmap(EncodeInfo *encInfo){
+
+    //Step 1 : Parse the header from the mapping, a WAV file is only streamed
+    if (carrier_parse_header(encInfo->src_map, encInfo->src_map_size, &encInfo->src_carrier) != success || encInfo->src_carrier.sample_size > 1){
+        printf("ERROR : Not an uncompressed BMP, PPM, PGM or TGA image\n");
+        return failure;
+    }
+
+    //Step 2 : Capacity is the part of the pixel array present in the file
+    if(!encInfo->quiet) printf("Width = %d\n", encInfo->src_carrier.width);
+    if(!encInfo->quiet) printf("Height = %d\n", encInfo->src_carrier.height);
+    if(!encInfo->quiet) printf("Bits per pixel = %d\n", encInfo->src_carrier.bpp);
+    encInfo->image_capacity = carrier_pixel_region(&encInfo->src_carrier, encInfo->src_map_size);
+
+    //Step 3 : Total bytes required for secret + metadata at the chosen depth, a compressed
+    //         secret is only known to fit once it is embedded
+    StegoHeader header;
+    fill_stego_header(encInfo, &header);
+    size_t total_required_bytes = encInfo->compress ? stego_header_size(&header) : stego_required_size(&header);
+
+    //Step 4 : The payload has to fit in the image as well as in the file
+    if (encInfo->image_capacity >= total_required_bytes){
+        return success;
+    }
+    else{
+        return failure;
+    }
+}
+
+/* Create the stego image at its final size and map it writable */
+Status create_stego_image_mmap(EncodeInfo *encInfo){
+
+    //Step 1 : Create the stego image
+    int fd = open(encInfo->stego_image_fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0){
+        perror("open");
+        fprintf(stderr, "ERROR : Unable to open file %s\n", encInfo->stego_image_fname);
+        return failure;
+    }
+
+    //Step 2 : Extend it to the size of the source image
+    if (ftruncate(fd, encInfo->src_map_size) != 0){
+        perror("ftruncate");
+        close(fd);
+        return failure;
+    }
+
+    //Step 3 : Map it, writes go straight to the page cache
+    void *addr = mmap(NULL, encInfo->src_map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED){
+        perror("mmap");
+        fprintf(stderr, "ERROR : Unable to map file %s\n", encInfo->stego_image_fname);
+        return failure;
+    }
+    encInfo->stego_map = addr;
+
+    return success;
+}
+
+/* Unmap all the mappings made by the mmap path */
+void close_files_mmap(EncodeInfo *encInfo){
+
+    if (encInfo->stego_map != NULL){
+        munmap(encInfo->stego_map, encInfo->src_map_size);
+        encInfo->stego_map = NULL;
+    }
+    if (encInfo->secret_map != NULL){
+        munmap((void *)encInfo->secret_map, encInfo->size_secret_file);
+        encInfo->secret_map = NULL;
+    }
+    if (encInfo->src_map != NULL){
+        munmap((void *)encInfo->src_map, encInfo->src_map_size);
+        encInfo->src_map = NULL;
+    }
+}
+
+/* Following function perform the encoding directly over the mapped files, without any fread/fwrite */
+/* Copy and embed one tile at a time, releasing the pages behind, so the memory used does not grow with the image */
+static Status embed_tiled(EncodeInfo *encInfo, const StegoHeader *header){
+
+    char *pixels = encInfo->stego_map + encInfo->src_carrier.pixel_offset;
+    size_t data_start = encInfo->src_carrier.pixel_offset + stego_header_size(header);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t done = 0, released = 0, secret_released = 0;
+
+    for(size_t pos = 0; pos < encInfo->src_map_size; pos += TILE_SIZE){
+        size_t end = encInfo->src_map_size - pos > TILE_SIZE ? pos + TILE_SIZE : encInfo->src_map_size;
+        memcpy(encInfo->stego_map + pos, encInfo->src_map + pos, end - pos);
+
+        //Embed the secret bytes whose groups are copied by now
+        size_t ready = end > data_start ? (end - data_start) / 8 * header->bits : 0;
+        if(ready > header->secret_size) ready = header->secret_size;
+        if(ready > done){
+            if(stego_embed_range(pixels, encInfo->image_capacity, header, encInfo->secret_map + done, done, ready - done, encInfo->threads) != success){
+                return failure;
+            }
+            done = ready;
+        }
+
+        //Nothing before the last embedded group is touched again but the header, which comes back on a fault
+        size_t finished = done == header->secret_size ? end : data_start + done / header->bits * 8;
+        if(finished > end) finished = end;
+        finished = finished / page * page;
+        if(finished > released){
+            madvise(encInfo->stego_map + released, finished - released, MADV_DONTNEED);
+            madvise((char *)encInfo->src_map + released, finished - released, MADV_DONTNEED);
+            released = finished;
+        }
+        if(done / page * page > secret_released){
+            madvise((char *)encInfo->secret_map + secret_released, done / page * page - secret_released, MADV_DONTNEED);
+            secret_released = done / page * page;
+        }
+    }
+
+    return stego_embed_header(pixels, encInfo->image_capacity, header);
+}
+
+Status do_encoding_mmap(EncodeInfo *encInfo){
+
+    //Step 1 : Map the source image and the secret file
+    stats_stage(encInfo->stats, "open");
+    if(open_files_mmap(encInfo) == success){
+        if(!encInfo->quiet) printf("INFO : Files are mapped sucessfully\n");
+    }
+    else{
+        printf("ERROR : Unable to map the file\n");
+        close_files_mmap(encInfo);
+        return failure;
+    }
+
+    //Step 2 : Check the capacity of the image
+    stats_stage(encInfo->stats, "capacity");
+    if(check_capacity_mmap(encInfo) == success){
+        if(!encInfo->quiet) printf("INFO : Image has enough capacity to encode the secret data into it\n");
+    }
+    else{
+        printf("ERROR : Image doesn't has enough capacity to hold the data\n");
+        close_files_mmap(encInfo);
+        return failure;
+    }
+
+    //Step 3 : Create the stego image with its final size
+    stats_stage(encInfo->stats, "create");
+    if(create_stego_image_mmap(encInfo) == success){
+        if(!encInfo->quiet) printf("INFO : Stego image is created and mapped sucessfully\n");
+    }
+    else{
+        printf("ERROR : Unable to create the stego image\n");
+        close_files_mmap(encInfo);
+        return failure;
+    }
+
+    //Step 4 : A flat secret, laid out in the order of the pixels, is copied and embedded tile by tile
+    StegoHeader header;
+    fill_stego_header(encInfo, &header);
+    Status embedded;
+    if((header.flags & ~STEGO_FLAG_WIDE) == 0){
+        stats_stage(encInfo->stats, "tiles");
+        embedded = embed_tiled(encInfo, &header);
+    }
+    else{
+        //Step 5 : Otherwise copy the header and the pixels in one pass, then encode in place
+        stats_stage(encInfo->stats, "copy");
+        memcpy(encInfo->stego_map, encInfo->src_map, encInfo->src_map_size);
+
+        stats_stage(encInfo->stats, "embed");
+        void *scratch = encInfo->arena ? arena_alloc(encInfo->arena, STEGO_SCRATCH_SIZE) : NULL;
+        embedded = stego_embed(encInfo->stego_map + encInfo->src_carrier.pixel_offset, encInfo->image_capacity, &header, encInfo->secret_map, encInfo->threads, scratch);
+    }
+    if(embedded == success){
+        if(!encInfo->quiet && encInfo->compress) printf("INFO : Secret data compressed from %zu to %zu bytes\n", header.original_size, header.secret_size);
+        if(!encInfo->quiet) printf("INFO : Secret data is sucessfully encoded into the mapped image\n");
+    }
+    else{
+        printf(encInfo->compress ? "ERROR : Image doesn't has enough capacity to hold the compressed data\n"
+                                 : "ERROR : Unable to encode the secret data\n");
+        close_files_mmap(encInfo);
+        unlink(encInfo->stego_image_fname);
+        return failure;
+    }
+
+    //Step 6 : Unmap the files, the kernel writes back the dirty pages
+    stats_stage(encInfo->stats, "unmap");
+    close_files_mmap(encInfo);
+
+    return success;
+}
\ No newline at end of file
@@ -1,7 +1,16 @@
 #ifndef ENCODE_H
 #define ENCODE_H
 #include <stdio.h>
+#include <stddef.h>
 #include "types.h"
+#include "common.h"
+#include "stats.h"
+#include "stego.h"
+#include "carrier.h"
+#include "arena.h"
+
+/* Block size used to copy the image tail when the kernel can't do it */
+#define TAIL_COPY_BLOCK_SIZE (64 * 1024)
 
 
 typedef struct EncodeInfo
@@ -9,19 +18,34 @@ typedef struct EncodeInfo
     /* Source Image info */
     char *src_image_fname; // To store the source image name
     FILE *fptr_src_image;  // To store the address of the source image
-    uint image_capacity;   // To store the size of image
+    size_t image_capacity; // To store the size of image
+    CarrierInfo src_carrier; // Header of the source image, parsed once
 
     /* Secret File Info */
     char *secret_fname;       // To store the secret file name
     FILE *fptr_secret;        // To store the secret file address
-    char extn_secret_file[5]; // To store the Secret file extension
-    char secret_data[100];    // To store the secret data
-    long size_secret_file;    // To store the size of the secret data
+    char extn_secret_file[MAX_EXTN_SIZE + 1]; // To store the Secret file extension
+    char secret_data[SECRET_CHUNK_SIZE];      // To store one chunk of the secret data
+    size_t size_secret_file;  // To store the size of the secret data
 
     /* Stego Image Info */
     char *stego_image_fname; // To store the dest file name
     FILE *fptr_stego_image;  // To store the address of stego image
 
+    /* Memory mapped view (--mmap) */
+    const char *src_map;     // Read only mapping of the source image
+    size_t src_map_size;     // Size of the source image mapping
+    const char *secret_map;  // Read only mapping of the secret file
+    char *stego_map;         // Writable mapping of the stego image
+    int threads;             // Threads used for the secret data (--threads)
+    int bits;                // LSBs per image byte (-k), 0 or 1 for the classic format
+    int compress;            // Compress the secret while embedding (--compress)
+    uint64_t key[2];         // Scatter key (--key), zero for none
+    size_t chunk_size;       // Bytes per chunk (--chunked), 0 for a flat secret
+    int quiet;               // Only print the errors (batch jobs)
+    StegoStats *stats;       // Per stage counters (--stats), NULL when off
+    Arena *arena;            // Job memory of a batch/daemon worker, NULL to use malloc
+
 } EncodeInfo;
 
 /* Encoding function prototype */
@@ -29,6 +53,9 @@ typedef struct EncodeInfo
 /* Read and validate Encode args from argv */
 Status read_and_validate_encode_args(char *argv[], EncodeInfo *encInfo);
 
+/* Store the extension of the secret file, empty if it has none */
+Status get_secret_file_extn(const char *secret_fname, char *extn);
+
 /* Perform the encoding */
 Status do_encoding(EncodeInfo *encInfo);
 
@@ -38,14 +65,11 @@ Status open_files(EncodeInfo *encInfo);
 /* check capacity */
 Status check_capacity(EncodeInfo *encInfo);
 
-/* Get image size */
-uint get_image_size_for_bmp(FILE *fptr_image);
-
 /* Get file size */
-uint get_file_size(FILE *fptr);
+size_t get_file_size(FILE *fptr);
 
-/* Copy bmp image header */
-Status copy_bmp_header(FILE *fptr_src_image, FILE *fptr_dest_image);
+/* Copy the image header, everything before the pixel array */
+Status copy_image_header(FILE *fptr_src_image, FILE *fptr_dest_image, size_t header_size);
 
 /* Store Magic String */
 Status encode_magic_string(const char *magic_string, EncodeInfo *encInfo);
@@ -57,7 +81,7 @@ Status encode_secret_file_extn_size(int size, EncodeInfo *encInfo);
 Status encode_secret_file_extn(const char *file_extn, EncodeInfo *encInfo);
 
 /* Encode secret file size */
-Status encode_secret_file_size(long file_size, EncodeInfo *encInfo);
+Status encode_secret_file_size(size_t file_size, EncodeInfo *encInfo);
 
 /* Encode secret file data*/
 Status encode_secret_file_data(EncodeInfo *encInfo);
@@ -66,9 +90,30 @@ Status encode_secret_file_data(EncodeInfo *encInfo);
 Status encode_byte_to_lsb(char data, char *image_buffer);
 
 // Encode a size to lsb
-Status encode_size_to_lsb(int size, char *imageBuffer);
+Status encode_size_to_lsb(size_t size, char *imageBuffer);
 
 /* Copy remaining image bytes from src to stego image after encoding */
 Status copy_remaining_img_data(FILE *fptr_src, FILE *fptr_dest);
 
+/* Perform the encoding over memory mapped files */
+Status do_encoding_mmap(EncodeInfo *encInfo);
+
+/* Map a whole file read only, size 0 files are not mapped */
+Status map_file_read_only(const char *fname, const char **map, size_t *size);
+
+/* Map the source image and secret file, read only */
+Status open_files_mmap(EncodeInfo *encInfo);
+
+/* Describe the secret for stego_embed */
+void fill_stego_header(const EncodeInfo *encInfo, StegoHeader *header);
+
+/* Check capacity using the mapped source image header */
+Status check_capacity_mmap(EncodeInfo *encInfo);
+
+/* Create the stego image at its final size and map it writable */
+Status create_stego_image_mmap(EncodeInfo *encInfo);
+
+/* Unmap all the mappings made by the mmap path */
+void close_files_mmap(EncodeInfo *encInfo);
+
 #endif
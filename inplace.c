@@ -0,0 +1,258 @@
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include "inplace.h"
+#include "encode.h"
+#include "stego.h"
+#include "carrier.h"
+#include "stats.h"
+#include "arena.h"
+#include "types.h"
+
+/* pread/pwrite the whole buffer */
+static Status pread_all(int fd, char *buffer, size_t size, off_t offset){
+
+    while (size > 0){
+        ssize_t n = pread(fd, buffer, size, offset);
+        if (n <= 0){
+            return failure;
+        }
+        buffer += n;
+        size -= n;
+        offset += n;
+    }
+    return success;
+}
+
+static Status pwrite_all(int fd, const char *buffer, size_t size, off_t offset){
+
+    while (size > 0){
+        ssize_t n = pwrite(fd, buffer, size, offset);
+        if (n <= 0){
+            return failure;
+        }
+        buffer += n;
+        size -= n;
+        offset += n;
+    }
+    return success;
+}
+
+/* Write back the runs of bytes that differ between old and new */
+static Status write_dirty_runs(int fd, const char *old, const char *new, size_t size, off_t offset,
+                               size_t *bytes_written, size_t *writes){
+
+    size_t i = 0;
+    *bytes_written = 0;
+    *writes = 0;
+
+    while (i < size){
+
+        //Step 1 : Skip the bytes that are already right
+        if (old[i] == new[i]){
+            i++;
+            continue;
+        }
+
+        //Step 2 : Extend the run, small clean gaps are cheaper to rewrite than to split
+        size_t start = i, end = i + 1, gap = 0;
+        for (size_t j = end; j < size && gap < IN_PLACE_MERGE_GAP; j++){
+            if (old[j] != new[j]){
+                end = j + 1;
+                gap = 0;
+            }
+            else{
+                gap++;
+            }
+        }
+
+        //Step 3 : One pwrite per run
+        if (pwrite_all(fd, new + start, end - start, offset + start) != success){
+            perror("pwrite");
+            return failure;
+        }
+        *bytes_written += end - start;
+        (*writes)++;
+        i = end;
+    }
+
+    return success;
+}
+
+/* Set the low bits of every byte to random values, so what was embedded there can't be read back */
+static Status randomise_lsbs(char *bytes, size_t size, int bits){
+
+    unsigned char noise[IN_PLACE_NOISE_SIZE];
+    unsigned char mask = (1u << bits) - 1;
+
+    while (size > 0){
+        size_t n = size < sizeof(noise) ? size : sizeof(noise);
+        ssize_t got = getrandom(noise, n, 0);
+        if (got <= 0){
+            return failure;
+        }
+        for (ssize_t i = 0; i < got; i++){
+            bytes[i] = (bytes[i] & ~mask) | (noise[i] & mask);
+        }
+        bytes += got;
+        size -= got;
+    }
+    return success;
+}
+
+/* Resources held by one in place job */
+typedef struct InPlaceJob
+{
+    int fd;              // The image, opened for reading and writing
+    const char *secret;  // Mapping of the secret file
+    size_t secret_size;
+    char *old;           // Payload region as it is in the file
+    char *new;           // Payload region with the new secret
+    Arena *arena;        // Where old and new come from, NULL for malloc
+} InPlaceJob;
+
+/* Release everything the job holds */
+static void close_in_place(InPlaceJob *job){
+
+    arena_free(job->arena, job->old);
+    arena_free(job->arena, job->new);
+    if (job->secret != NULL){
+        munmap((void *)job->secret, job->secret_size);
+    }
+    if (job->fd >= 0){
+        close(job->fd);
+    }
+}
+
+/* Embed into the source image itself, or replace the secret of an existing stego image */
+Status do_encoding_in_place(EncodeInfo *encInfo, int update){
+
+    InPlaceJob job = { -1, NULL, 0, NULL, NULL, encInfo->arena };
+
+    //Step 1 : Open the image for reading and writing, parse its header and map the secret
+    stats_stage(encInfo->stats, "open");
+    job.fd = open(encInfo->src_image_fname, O_RDWR);
+    if (job.fd < 0){
+        perror("open");
+        fprintf(stderr, "ERROR : Unable to open file %s\n", encInfo->src_image_fname);
+        return failure;
+    }
+    off_t file_size = lseek(job.fd, 0, SEEK_END);
+    if (carrier_pread_header(job.fd, &encInfo->src_carrier) != success || encInfo->src_carrier.sample_size > 1){
+        printf("ERROR : Not an uncompressed BMP, PPM, PGM or TGA image\n");
+        close_in_place(&job);
+        return failure;
+    }
+    size_t region = carrier_pixel_region(&encInfo->src_carrier, file_size);
+    off_t pixel_offset = encInfo->src_carrier.pixel_offset;
+
+    if (map_file_read_only(encInfo->secret_fname, &job.secret, &job.secret_size) != success){
+        close_in_place(&job);
+        return failure;
+    }
+    encInfo->size_secret_file = job.secret_size;
+
+    //Step 2 : For an update the image has to hold a secret already, its depth is kept unless -k is given
+    stats_stage(encInfo->stats, "old_header");
+    size_t stale = 0;
+    int stale_bits = 0;
+    if (update){
+        char old_header[STEGO_MAX_HEADER_SIZE];
+        StegoHeader current = {0};
+        size_t n = region < sizeof(old_header) ? region : sizeof(old_header);
+
+        if (pread_all(job.fd, old_header, n, pixel_offset) != success ||
+            stego_read_header(old_header, region, &current) != success){
+            printf("ERROR : %s doesn't contain any secret data (not a stego file)\n", encInfo->src_image_fname);
+            close_in_place(&job);
+            return failure;
+        }
+        if (encInfo->bits == 0){
+            encInfo->bits = current.bits;
+        }
+        // The old payload, to be wiped where the new one doesn't cover it. Scattered blocks can be anywhere
+        stale = (current.flags & STEGO_FLAG_SCATTERED) ? region : stego_required_size(&current);
+        stale = stale < region ? stale : region;
+        stale_bits = current.bits;
+        if(!encInfo->quiet) printf("INFO : Replacing a secret of %zu bytes\n", current.secret_size);
+    }
+
+    //Step 3 : Capacity
+    stats_stage(encInfo->stats, "capacity");
+    StegoHeader header;
+    fill_stego_header(encInfo, &header);
+    size_t required = stego_embed_bound(&header);
+    encInfo->image_capacity = region;
+    if (encInfo->compress && required > region){
+        required = region;
+    }
+    // Scattered blocks can land anywhere, and their order depends on the whole region
+    if ((header.flags & STEGO_FLAG_SCATTERED) && required <= region){
+        required = region;
+    }
+    if (required > region){
+        printf("ERROR : Image doesn't has enough capacity to hold the data\n");
+        close_in_place(&job);
+        return failure;
+    }
+    size_t covered = required > stale ? required : stale;
+
+    //Step 4 : Read only the bytes the new and the old payload cover
+    stats_stage(encInfo->stats, "read");
+    job.old = arena_alloc(job.arena, covered);
+    job.new = arena_alloc(job.arena, covered);
+    if (job.old == NULL || job.new == NULL){
+        printf("ERROR : Unable to allocate %zu bytes for the payload region\n", covered);
+        close_in_place(&job);
+        return failure;
+    }
+    if (pread_all(job.fd, job.old, covered, pixel_offset) != success){
+        perror("pread");
+        close_in_place(&job);
+        return failure;
+    }
+
+    //Step 5 : Embed into a copy, so old and new can be compared. Scattered blocks leave gaps anywhere and
+    // fewer bits leave the upper old ones, so then the old payload is wiped first, else only its tail is
+    stats_stage(encInfo->stats, "embed");
+    memcpy(job.new, job.old, covered);
+    int wipe_first = (header.flags & STEGO_FLAG_SCATTERED) || stale_bits > header.bits;
+    if (stale > 0 && wipe_first && randomise_lsbs(job.new, stale, stale_bits) != success){
+        perror("getrandom");
+        close_in_place(&job);
+        return failure;
+    }
+    void *scratch = job.arena ? arena_alloc(job.arena, STEGO_SCRATCH_SIZE) : NULL;
+    if (stego_embed(job.new, required, &header, job.secret, encInfo->threads, scratch) != success){
+        printf(encInfo->compress ? "ERROR : Image doesn't has enough capacity to hold the compressed data\n"
+                                 : "ERROR : Unable to encode the secret data\n");
+        close_in_place(&job);
+        return failure;
+    }
+    size_t used = wipe_first ? covered : stego_required_size(&header);
+    if (stale > used && randomise_lsbs(job.new + used, stale - used, stale_bits) != success){
+        perror("getrandom");
+        close_in_place(&job);
+        return failure;
+    }
+
+    //Step 6 : Write back only the bytes whose LSBs changed
+    stats_stage(encInfo->stats, "write");
+    size_t bytes_written, writes;
+    if (write_dirty_runs(job.fd, job.old, job.new, covered, pixel_offset, &bytes_written, &writes) != success){
+        close_in_place(&job);
+        return failure;
+    }
+    if(!encInfo->quiet) printf("INFO : %zu of %zu payload bytes rewritten with %zu writes\n", bytes_written, covered, writes);
+
+    //Step 7 : Close
+    stats_stage(encInfo->stats, "close");
+    close_in_place(&job);
+
+    return success;
+}
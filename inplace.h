@@ -0,0 +1,23 @@
+#ifndef INPLACE_H
+#define INPLACE_H
+
+/* Header Files */
+#include "types.h"
+#include "encode.h"
+
+/* Dirty runs closer than this are written with one pwrite */
+#define IN_PLACE_MERGE_GAP 64
+
+/* Random bytes drawn at a time to wipe the LSBs of an old payload */
+#define IN_PLACE_NOISE_SIZE 4096
+
+/*
+ * Embed into the source image itself (--in-place), or replace the secret of
+ * an existing stego image (--update). Only the payload region is read, and
+ * only the image bytes whose LSBs change are written back with pwrite. An
+ * update also covers the old payload, the LSBs the new one leaves are set
+ * to random values.
+ */
+Status do_encoding_in_place(EncodeInfo *encInfo, int update);
+
+#endif
@@ -0,0 +1,416 @@
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "lsb.h"
+#include "types.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LSB_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* One set of kernels */
+typedef struct LsbKernels
+{
+    const char *name;
+    void (*encode)(const unsigned char *data, size_t size, unsigned char *image_buffer);
+    void (*decode)(unsigned char *data, size_t size, const unsigned char *image_buffer);
+} LsbKernels;
+
+/* Scalar kernels, the same loops as encode_byte_to_lsb / decode_byte_from_lsb */
+static void encode_scalar(const unsigned char *data, size_t size, unsigned char *image_buffer){
+
+    for (size_t i = 0; i < size; i++){
+        for (int bit = 0; bit < 8; bit++){
+            image_buffer[i * 8 + bit] = (image_buffer[i * 8 + bit] & ~1) | ((data[i] >> bit) & 1);
+        }
+    }
+}
+
+static void decode_scalar(unsigned char *data, size_t size, const unsigned char *image_buffer){
+
+    for (size_t i = 0; i < size; i++){
+        unsigned char byte = 0;
+        for (int bit = 0; bit < 8; bit++){
+            byte |= (image_buffer[i * 8 + bit] & 1) << bit;
+        }
+        data[i] = byte;
+    }
+}
+
+#ifdef LSB_HAVE_X86
+
+/* SSE2 : 16 data bytes into 128 image bytes per iteration */
+__attribute__((target("sse2")))
+static void encode_sse2(const unsigned char *data, size_t size, unsigned char *image_buffer){
+
+    // Bit i of every 8 byte group is selected by 1 << i
+    const __m128i bit_mask = _mm_set_epi8((char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1,
+                                          (char)0x80, 0x40, 0x20, 0x10, 8, 4, 2, 1);
+    const __m128i one = _mm_set1_epi8(1);
+    const __m128i keep = _mm_set1_epi8((char)0xFE);
+    size_t i = 0;
+
+    for (; i + 16 <= size; i += 16){
+
+        // Spread every data byte over 8 lanes : p0 x8 p1 x8 ... p15 x8
+        __m128i p = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i lo = _mm_unpacklo_epi8(p, p);
+        __m128i hi = _mm_unpackhi_epi8(p, p);
+        __m128i quad[4] = { _mm_unpacklo_epi16(lo, lo), _mm_unpackhi_epi16(lo, lo),
+                            _mm_unpacklo_epi16(hi, hi), _mm_unpackhi_epi16(hi, hi) };
+        unsigned char *out = image_buffer + i * 8;
+
+        for (int q = 0; q < 4; q++){
+            __m128i spread[2] = { _mm_unpacklo_epi32(quad[q], quad[q]), _mm_unpackhi_epi32(quad[q], quad[q]) };
+
+            for (int h = 0; h < 2; h++){
+                __m128i bits = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(spread[h], bit_mask), bit_mask), one);
+                __m128i *dst = (__m128i *)(out + (q * 2 + h) * 16);
+                __m128i img = _mm_loadu_si128(dst);
+                _mm_storeu_si128(dst, _mm_or_si128(_mm_and_si128(img, keep), bits));
+            }
+        }
+    }
+
+    // Remaining bytes
+    encode_scalar(data + i, size - i, image_buffer + i * 8);
+}
+
+/* SSE2 : movemask gathers the LSB of 16 image bytes into 2 data bytes */
+__attribute__((target("sse2")))
+static void decode_sse2(unsigned char *data, size_t size, const unsigned char *image_buffer){
+
+    size_t i = 0;
+
+    for (; i + 2 <= size; i += 2){
+        __m128i img = _mm_loadu_si128((const __m128i *)(image_buffer + i * 8));
+        int mask = _mm_movemask_epi8(_mm_slli_epi16(img, 7));
+        data[i] = mask & 0xFF;
+        data[i + 1] = (mask >> 8) & 0xFF;
+    }
+
+    // Remaining bytes
+    decode_scalar(data + i, size - i, image_buffer + i * 8);
+}
+
+/* AVX2 : 32 data bytes into 256 image bytes per iteration */
+__attribute__((target("avx2")))
+static void encode_avx2(const unsigned char *data, size_t size, unsigned char *image_buffer){
+
+    // Lane 0 takes data bytes 0,1 and lane 1 takes data bytes 2,3 of every 4 byte group
+    const __m256i spread_index = _mm256_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+                                                  2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i bit_mask = _mm256_setr_epi8(1, 2, 4, 8, 0x10, 0x20, 0x40, (char)0x80,
+                                              1, 2, 4, 8, 0x10, 0x20, 0x40, (char)0x80,
+                                              1, 2, 4, 8, 0x10, 0x20, 0x40, (char)0x80,
+                                              1, 2, 4, 8, 0x10, 0x20, 0x40, (char)0x80);
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i keep = _mm256_set1_epi8((char)0xFE);
+    size_t i = 0;
+
+    for (; i + 32 <= size; i += 32){
+        for (int g = 0; g < 8; g++){
+            int word;
+            memcpy(&word, data + i + g * 4, 4);
+            __m256i spread = _mm256_shuffle_epi8(_mm256_set1_epi32(word), spread_index);
+            __m256i bits = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(spread, bit_mask), bit_mask), one);
+            __m256i *dst = (__m256i *)(image_buffer + (i + g * 4) * 8);
+            __m256i img = _mm256_loadu_si256(dst);
+            _mm256_storeu_si256(dst, _mm256_or_si256(_mm256_and_si256(img, keep), bits));
+        }
+    }
+
+    // Remaining bytes
+    encode_sse2(data + i, size - i, image_buffer + i * 8);
+}
+
+/* AVX2 : movemask gathers the LSB of 32 image bytes into 4 data bytes */
+__attribute__((target("avx2")))
+static void decode_avx2(unsigned char *data, size_t size, const unsigned char *image_buffer){
+
+    size_t i = 0;
+
+    for (; i + 4 <= size; i += 4){
+        __m256i img = _mm256_loadu_si256((const __m256i *)(image_buffer + i * 8));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(_mm256_slli_epi16(img, 7));
+        data[i] = mask & 0xFF;
+        data[i + 1] = (mask >> 8) & 0xFF;
+        data[i + 2] = (mask >> 16) & 0xFF;
+        data[i + 3] = (mask >> 24) & 0xFF;
+    }
+
+    // Remaining bytes
+    decode_sse2(data + i, size - i, image_buffer + i * 8);
+}
+
+#endif
+
+static const LsbKernels scalar_kernels = { "scalar", encode_scalar, decode_scalar };
+#ifdef LSB_HAVE_X86
+static const LsbKernels sse2_kernels = { "sse2", encode_sse2, decode_sse2 };
+static const LsbKernels avx2_kernels = { "avx2", encode_avx2, decode_avx2 };
+#endif
+
+static const LsbKernels *active_kernels = &scalar_kernels;
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+/* Pick the fastest kernels the CPU supports, once per process */
+static void select_kernels(void){
+
+    const char *forced = getenv("STEGO_LSB_KERNEL");
+
+#ifdef LSB_HAVE_X86
+    __builtin_cpu_init();
+    int have_sse2 = __builtin_cpu_supports("sse2");
+    int have_avx2 = __builtin_cpu_supports("avx2");
+
+    if (forced != NULL && strcmp(forced, "scalar") == 0){
+        active_kernels = &scalar_kernels;
+    }
+    else if (forced != NULL && strcmp(forced, "sse2") == 0 && have_sse2){
+        active_kernels = &sse2_kernels;
+    }
+    else if (have_avx2 && (forced == NULL || strcmp(forced, "avx2") == 0)){
+        active_kernels = &avx2_kernels;
+    }
+    else if (have_sse2){
+        active_kernels = &sse2_kernels;
+    }
+#else
+    (void)forced;
+#endif
+}
+
+/* Encode a buffer of bytes into LSB of image data array */
+Status encode_data_to_lsb(const char *data, size_t size, char *image_buffer){
+
+    pthread_once(&kernels_once, select_kernels);
+    active_kernels->encode((const unsigned char *)data, size, (unsigned char *)image_buffer);
+    return success;
+}
+
+/* Decode a buffer of bytes from LSB of image data */
+Status decode_data_from_lsb(char *data, size_t size, const char *image_buffer){
+
+    pthread_once(&kernels_once, select_kernels);
+    active_kernels->decode((unsigned char *)data, size, (const unsigned char *)image_buffer);
+    return success;
+}
+
+/* Name of the kernel in use */
+const char *lsb_kernel_name(void){
+
+    pthread_once(&kernels_once, select_kernels);
+    return active_kernels->name;
+}
+
+/*
+ * k-LSB tables : spread_table[bits - 1][pos][byte] is byte, as data byte pos
+ * of a group of bits data bytes, already spread over the 8 image bytes of the
+ * group, as a little endian 64 bit word.
+ */
+static uint64_t spread_table[LSB_MAX_BITS][LSB_MAX_BITS][256];
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void build_spread_tables(void){
+
+    for (int bits = 1; bits <= LSB_MAX_BITS; bits++){
+        for (int pos = 0; pos < bits; pos++){
+            for (int byte = 0; byte < 256; byte++){
+                uint64_t word = 0;
+                for (int bit = 0; bit < 8; bit++){
+                    int stream = pos * 8 + bit;
+                    if ((byte >> bit) & 1){
+                        word |= 1ULL << ((stream / bits) * 8 + stream % bits);
+                    }
+                }
+                spread_table[bits - 1][pos][byte] = word;
+            }
+        }
+    }
+}
+
+/* The LSB mask repeated over the 8 bytes of a word */
+static uint64_t lane_mask(int bits){
+
+    return 0x0101010101010101ULL * ((1u << bits) - 1);
+}
+
+/* Image bytes needed for size data bytes at bits LSBs per image byte */
+size_t lsb_image_size(size_t size, int bits){
+
+    return (size * 8 + bits - 1) / bits;
+}
+
+/* Bit by bit, for the last group that has less than bits data bytes */
+static void encode_bits_tail(const unsigned char *data, size_t size, unsigned char *image_buffer, int bits){
+
+    for (size_t stream = 0; stream < size * 8; stream++){
+        unsigned char bit = (data[stream / 8] >> (stream % 8)) & 1;
+        unsigned char *byte = &image_buffer[stream / bits];
+        *byte = (*byte & ~(1u << (stream % bits))) | (bit << (stream % bits));
+    }
+}
+
+static void decode_bits_tail(unsigned char *data, size_t size, const unsigned char *image_buffer, int bits){
+
+    memset(data, 0, size);
+    for (size_t stream = 0; stream < size * 8; stream++){
+        unsigned char bit = (image_buffer[stream / bits] >> (stream % bits)) & 1;
+        data[stream / 8] |= bit << (stream % 8);
+    }
+}
+
+/* Encode a buffer of bytes into the bits LSBs of image data array */
+Status encode_data_to_lsb_k(const char *data, size_t size, char *image_buffer, int bits){
+
+    if (bits < 1 || bits > LSB_MAX_BITS){
+        return failure;
+    }
+    if (bits == 1){
+        return encode_data_to_lsb(data, size, image_buffer);
+    }
+    pthread_once(&tables_once, build_spread_tables);
+
+    const unsigned char *in = (const unsigned char *)data;
+    unsigned char *out = (unsigned char *)image_buffer;
+    const uint64_t (*table)[256] = spread_table[bits - 1];
+    uint64_t keep = ~lane_mask(bits);
+    size_t groups = size / bits;
+
+    // Every group of bits data bytes goes into one 64 bit word of the image
+    for (size_t g = 0; g < groups; g++, in += bits, out += 8){
+        uint64_t word;
+        memcpy(&word, out, 8);
+        word &= keep;
+        for (int pos = 0; pos < bits; pos++){
+            word |= table[pos][in[pos]];
+        }
+        memcpy(out, &word, 8);
+    }
+
+    encode_bits_tail(in, size % bits, out, bits);
+    return success;
+}
+
+/* Decode a buffer of bytes from the bits LSBs of image data */
+Status decode_data_from_lsb_k(char *data, size_t size, const char *image_buffer, int bits){
+
+    if (bits < 1 || bits > LSB_MAX_BITS){
+        return failure;
+    }
+    if (bits == 1){
+        return decode_data_from_lsb(data, size, image_buffer);
+    }
+
+    unsigned char *out = (unsigned char *)data;
+    const unsigned char *in = (const unsigned char *)image_buffer;
+    uint64_t mask = (1u << bits) - 1;
+    size_t groups = size / bits;
+
+    // Gather the bits LSBs of the 8 image bytes of a group back into bits data bytes
+    for (size_t g = 0; g < groups; g++, in += 8, out += bits){
+        uint64_t word;
+        uint32_t value = 0;
+        memcpy(&word, in, 8);
+        for (int lane = 0; lane < 8; lane++){
+            value |= ((word >> (lane * 8)) & mask) << (lane * bits);
+        }
+        for (int pos = 0; pos < bits; pos++){
+            out[pos] = value >> (pos * 8);
+        }
+    }
+
+    decode_bits_tail(out, size % bits, in, bits);
+    return success;
+}
+
+/* One stripe of the payload, data group i always maps to image bytes 8*i .. 8*i+7 */
+typedef struct LsbStripe
+{
+    char *data;
+    size_t size;
+    char *image_buffer;
+    int bits;
+    int decode;
+} LsbStripe;
+
+static void *run_stripe(void *arg){
+
+    LsbStripe *stripe = arg;
+    if (stripe->decode){
+        decode_data_from_lsb_k(stripe->data, stripe->size, stripe->image_buffer, stripe->bits);
+    }
+    else{
+        encode_data_to_lsb_k(stripe->data, stripe->size, stripe->image_buffer, stripe->bits);
+    }
+    return NULL;
+}
+
+/* Split the payload into disjoint stripes and run them on threads, the caller takes the first one */
+static Status run_striped(char *data, size_t size, char *image_buffer, int bits, int threads, int decode){
+
+    if (bits < 1 || bits > LSB_MAX_BITS){
+        return failure;
+    }
+
+    //Step 1 : Don't start threads for stripes that are too small to pay for them
+    if ((size_t)threads > size / LSB_MIN_STRIPE_SIZE){
+        threads = size / LSB_MIN_STRIPE_SIZE;
+    }
+    if (threads <= 1){
+        LsbStripe whole = { data, size, image_buffer, bits, decode };
+        run_stripe(&whole);
+        return success;
+    }
+
+    //Step 2 : Stripes are whole groups of 64 words, so they are cache line aligned in the image
+    LsbStripe stripes[threads];
+    pthread_t tids[threads];
+    size_t unit = 64 * bits;
+    size_t per_thread = (size / threads + unit - 1) / unit * unit;
+    size_t offset = 0;
+
+    for (int t = 0; t < threads; t++){
+        size_t len = (size - offset < per_thread) ? size - offset : per_thread;
+        stripes[t] = (LsbStripe){ data + offset, len, image_buffer + offset * 8 / bits, bits, decode };
+        offset += len;
+    }
+
+    //Step 3 : Start the workers, on failure the remaining stripes run on this thread
+    int started = 1;
+    for (int t = 1; t < threads; t++){
+        if (pthread_create(&tids[t], NULL, run_stripe, &stripes[t]) != 0){
+            break;
+        }
+        started++;
+    }
+
+    run_stripe(&stripes[0]);
+    for (int t = started; t < threads; t++){
+        run_stripe(&stripes[t]);
+    }
+
+    //Step 4 : Wait for all the workers
+    for (int t = 1; t < started; t++){
+        pthread_join(tids[t], NULL);
+    }
+
+    return success;
+}
+
+/* Same as encode_data_to_lsb_k, with the data split into stripes over threads */
+Status encode_data_to_lsb_parallel(const char *data, size_t size, char *image_buffer, int bits, int threads){
+
+    return run_striped((char *)data, size, image_buffer, bits, threads, 0);
+}
+
+/* Same as decode_data_from_lsb_k, with the data split into stripes over threads */
+Status decode_data_from_lsb_parallel(char *data, size_t size, const char *image_buffer, int bits, int threads){
+
+    return run_striped(data, size, (char *)image_buffer, bits, threads, 1);
+}
@@ -0,0 +1,52 @@
+#ifndef LSB_H
+#define LSB_H
+
+/* Header Files */
+#include <stddef.h>
+#include "types.h"
+
+/* Smallest stripe handed to a thread, smaller payloads stay on one thread */
+#define LSB_MIN_STRIPE_SIZE (64 * 1024)
+
+/* Most LSBs per image byte */
+#define LSB_MAX_BITS 4
+
+/*
+ * Bulk LSB kernels. Every data byte goes into the LSB of 8 image bytes,
+ * bit 0 first, exactly like encode_byte_to_lsb / decode_byte_from_lsb.
+ * The SSE2/AVX2 versions are picked at run time, the scalar loop is the
+ * fallback, and all of them give bit identical output.
+ * STEGO_LSB_KERNEL=scalar|sse2|avx2 in the environment forces one of them.
+ */
+
+/* Encode a buffer of bytes into LSB of image data array */
+Status encode_data_to_lsb(const char *data, size_t size, char *image_buffer);
+
+/* Decode a buffer of bytes from LSB of image data */
+Status decode_data_from_lsb(char *data, size_t size, const char *image_buffer);
+
+/*
+ * k-LSB kernels, bits (1..4) LSBs of every image byte carry data. The data
+ * is one bit stream, bit 0 of byte 0 first, so every bits data bytes fill
+ * exactly 8 image bytes. bits == 1 is the same as the kernels above.
+ */
+
+/* Image bytes needed for size data bytes at bits LSBs per image byte */
+size_t lsb_image_size(size_t size, int bits);
+
+/* Encode a buffer of bytes into the bits LSBs of image data array */
+Status encode_data_to_lsb_k(const char *data, size_t size, char *image_buffer, int bits);
+
+/* Decode a buffer of bytes from the bits LSBs of image data */
+Status decode_data_from_lsb_k(char *data, size_t size, const char *image_buffer, int bits);
+
+/* Same as encode_data_to_lsb_k, with the data split into stripes over threads */
+Status encode_data_to_lsb_parallel(const char *data, size_t size, char *image_buffer, int bits, int threads);
+
+/* Same as decode_data_from_lsb_k, with the data split into stripes over threads */
+Status decode_data_from_lsb_parallel(char *data, size_t size, const char *image_buffer, int bits, int threads);
+
+/* Name of the kernel in use: "avx2", "sse2" or "scalar" */
+const char *lsb_kernel_name(void);
+
+#endif
@@ -12,20 +12,139 @@
 #include "types.h"
 #include "encode.h"
 #include "decode.h"
+#include "batch.h"
+#include "inplace.h"
+#include "scan.h"
+#include "uring_jobs.h"
+#include "daemon.h"
+#include "options.h"
+#include "scatter.h"
+#include "stream.h"
+#include "stripe.h"
+#include "catalog.h"
+#include "carrier.h"
+#include "stats.h"
 #include "string.h"
 
 
+/* Run a single -e / -d job on io_uring, fails when io_uring is unavailable */
+static Status run_one_job_uring(OperationType type, char *arg1, char *arg2, char *arg3, const StegoOptions *opts, StegoStats *stats, Status *status){
+
+    BatchJob job = { type, 0, { arg1, arg2, arg3 }, failure, 0 };
+
+    // Reads, embedding/extraction and writes overlap, so they are one stage
+    stats_stage(stats, "io_uring");
+
+    if (run_jobs_uring(&job, 1, opts->bits, opts->compress) != success){
+        printf("INFO : io_uring is not available, using the mmap path\n");
+        return failure;
+    }
+    *status = job.status;
+    return success;
+}
+
+/* Send a single -e / -d job to the daemon, fails when it can't be reached */
+static Status run_one_job_daemon(OperationType type, char *arg1, char *arg2, char *arg3, const StegoOptions *opts, Status *status){
+
+    char *args[3] = { arg1, arg2, arg3 };
+
+    if (daemon_submit(opts->socket, type, args, opts->bits, opts->compress, status) != success){
+        printf("INFO : No daemon on %s, running the job here\n", opts->socket);
+        return failure;
+    }
+    return success;
+}
+
 /* Main function */
 int main(int argc, char *argv[]){
 
+    // Step 0 : Take out the options, only the positional arguments are left in argv
+    StegoOptions opts;
+    if(parse_options(&argc, argv, &opts) != success){
+        return 1;
+    }
+
+    // Per stage counters, printed on stderr when --stats is given
+    StegoStats stats;
+    stats_init(opts.stats ? &stats : NULL);
+
+    // Batch mode : lsb_steg batch <manifest> [--threads N] [--io-uring]
+    if(argc == 3 && check_operation_type(argv[1]) == e_batch){
+        return do_batch(argv[2], opts.threads, opts.io_uring) == success ? 0 : 1;
+    }
+
+    // Daemon mode : lsb_steg daemon <socket> [--threads N]
+    if(argc == 3 && check_operation_type(argv[1]) == e_daemon){
+        return do_daemon(argv[2], opts.threads) == success ? 0 : 1;
+    }
+
+    // Scan mode : lsb_steg scan <dir|file>... [--threads N]
+    if(argc >= 3 && check_operation_type(argv[1]) == e_scan){
+        return do_scan(argv + 2, argc - 2, opts.threads) == success ? 0 : 1;
+    }
+
+    // Carrier index : lsb_steg index <index> <dir|file>... / lsb_steg fit <index> <secret> [-k N] [--key TEXT] [--chunked]
+    if(argc >= 4 && check_operation_type(argv[1]) == e_index){
+        return do_index(argv[2], argv + 3, argc - 3) == success ? 0 : 1;
+    }
+    if(argc == 4 && check_operation_type(argv[1]) == e_fit){
+        if(opts.compress){
+            printf("ERROR : The size of a compressed secret is only known once it is embedded, fit can't use --compress\n");
+            return 1;
+        }
+        uint64_t key[2] = { 0, 0 };
+        if(opts.key) scatter_key_from_string(opts.key, key);
+        return do_fit(argv[2], argv[3], opts.bits, key, opts.chunked ? STEGO_CHUNK_SIZE : 0) == success ? 0 : 1;
+    }
+
+    // Striping : lsb_steg stripe <secret> <out prefix> <carrier.bmp>... / lsb_steg join <output> <stego.bmp>...
+    if((argc >= 5 && check_operation_type(argv[1]) == e_stripe) || (argc >= 4 && check_operation_type(argv[1]) == e_join)){
+        if(opts.compress || opts.chunked || opts.range || opts.in_place || opts.update){
+            printf("ERROR : --compress, --chunked, --range, --in-place and --update can't be used with %s\n", argv[1]);
+            return 1;
+        }
+        uint64_t key[2] = { 0, 0 };
+        if(opts.key) scatter_key_from_string(opts.key, key);
+        Status status = check_operation_type(argv[1]) == e_stripe
+                        ? do_stripe(argv[2], argv[3], argv + 4, argc - 4, opts.bits, key, opts.threads)
+                        : do_join(argv[2], argv + 3, argc - 3, key, opts.threads);
+        return status == success ? 0 : 1;
+    }
+
     // Step 1 : Check the count of the argument, if less than or equal to 3, it will print the error message and finish the program
     if(argc <= 3){
         //printf("ERROR : Argc count is less than or equal to 3\n");
-        printf("Usage: %s -e <source.bmp> <secret.txt> [output.bmp]\n", argv[0]);
-        printf("   or: %s -d <stego.bmp> [output.txt]\n", argv[0]);
+        printf("Usage: %s -e <source.bmp> <secret.txt> [output.bmp] [-k 1-4] [--compress | --chunked] [--key TEXT] [--mmap] [--io-uring] [--socket PATH] [--threads N] [--stats]\n", argv[0]);
+        printf("   or: %s -e <image.bmp> <secret.txt> --in-place | --update [-k 1-4] [--compress | --chunked] [--key TEXT] [--threads N] [--stats]\n", argv[0]);
+        printf("   or: %s -d <stego.bmp> [output.txt] [--range A:B] [--key TEXT] [--mmap] [--io-uring] [--socket PATH] [--threads N] [--stats]\n", argv[0]);
+        printf("   or: %s -e - <secret.txt> - [-k 1-4] [--threads N] [--stats] < source.bmp > stego.bmp\n", argv[0]);
+        printf("   or: %s -d - - [--threads N] [--stats] < stego.bmp > output.txt\n", argv[0]);
+        printf("   or: %s batch <manifest> [--threads N] [--io-uring]\n", argv[0]);
+        printf("   or: %s daemon <socket> [--threads N]\n", argv[0]);
+        printf("   or: %s scan <dir|file>... [--threads N]\n", argv[0]);
+        printf("   or: %s stripe <secret> <out prefix> <carrier.bmp>... [-k 1-4] [--key TEXT] [--threads N]\n", argv[0]);
+        printf("   or: %s join <output> <stego.bmp>... [--key TEXT] [--threads N]\n", argv[0]);
+        printf("   or: %s index <index file> <dir|file>...\n", argv[0]);
+        printf("   or: %s fit <index file> <secret> [-k 1-4] [--key TEXT] [--chunked]\n", argv[0]);
+        printf("Images : .bmp (24/32 bit), .ppm/.pgm/.pnm (binary, 8 bit samples), .tga (uncompressed 8/24/32 bit)\n");
+        printf("Audio  : .wav (16 bit PCM), streamed, only the plain -e / -d\n");
         return 1;
     }
 
+    // Streaming : "-" for an input reads stdin, "-" for the output keeps stdout for the data and the messages go to stderr.
+    // A WAV carrier is always streamed, its carrier bytes are every other byte of the file
+    const char *stream_out = check_operation_type(argv[1]) == e_encode ? argv[4] : argv[3];
+    const CarrierBackend *backend = carrier_backend_for_name(argv[2]);
+    int stream = is_stream_name(argv[2]) || is_stream_name(stream_out) || (backend != NULL && backend->streamed);
+    int stream_fd = -1;
+    if(is_stream_name(stream_out) && (stream_fd = stream_claim_stdout()) < 0){
+        perror("dup");
+        return 1;
+    }
+
+    // The daemon and the io_uring jobs don't carry the key, the chunk layout nor a range
+    int local_only = opts.key || opts.chunked || opts.range;
+
     //Step 2 : Call the function for finding the operation type
     //For finding the  operation type is encoding 
     if(check_operation_type(argv[1]) == e_encode){
@@ -33,7 +152,7 @@ int main(int argc, char *argv[]){
         printf("You have selected encoding operation\n");
 
         //Stpe 2.1 : Declare the structure 
-        EncodeInfo enc_info;
+        EncodeInfo enc_info = {0};
 
         //Step 2.2 Call the read_and_validate_encode_args function, and validate the arguments
         if(read_and_validate_encode_args(argv, &enc_info) == success){
@@ -41,8 +160,45 @@ int main(int argc, char *argv[]){
             printf("INFO : Sucessfully read and validate the arguments\n");
             printf("#################### Start the Encoding ####################\n");
        
-            //Step 2.2.1 Call do_encoding function
-            if(do_encoding(&enc_info) == success){
+            enc_info.threads = opts.threads;
+            enc_info.bits = opts.bits;
+            enc_info.compress = opts.compress;
+            if(opts.key) scatter_key_from_string(opts.key, enc_info.key);
+            enc_info.chunk_size = opts.chunked ? STEGO_CHUNK_SIZE : 0;
+            enc_info.stats = opts.stats ? &stats : NULL;
+
+            //Step 2.2.1 Call do_encoding function, the mmap one when --mmap is given, or the in place one
+            Status status;
+            const char *path;
+            if(stream){
+                if(opts.in_place || opts.update){
+                    printf("ERROR : --in-place / --update need a file, not a stream nor a WAV file\n");
+                    return 1;
+                }
+                path = "stream";
+                status = do_encoding_stream(&enc_info, stream_fd);
+            }
+            else if(opts.in_place || opts.update){
+                if(argv[4] != NULL){
+                    printf("ERROR : No output file is written with --in-place / --update\n");
+                    return 1;
+                }
+                path = opts.update ? "update" : "in-place";
+                status = do_encoding_in_place(&enc_info, opts.update);
+            }
+            else if(opts.socket && !local_only && run_one_job_daemon(e_encode, argv[2], argv[3], enc_info.stego_image_fname, &opts, &status) == success){
+                path = "daemon";
+            }
+            else if(opts.io_uring && !local_only && run_one_job_uring(e_encode, argv[2], argv[3], enc_info.stego_image_fname, &opts, enc_info.stats, &status) == success){
+                path = "io_uring";
+            }
+            else{
+                path = (opts.use_mmap || opts.io_uring) ? "mmap" : "stdio";
+                status = (opts.use_mmap || opts.io_uring) ? do_encoding_mmap(&enc_info) : do_encoding(&enc_info);
+            }
+            stats_print_json(enc_info.stats, stderr, "encode", path, status);
+            stats_close(enc_info.stats);
+            if(status == success){
                 printf("############# Encoding Successfully Completed #############\n");
                 return 0;
             }
@@ -59,15 +215,40 @@ int main(int argc, char *argv[]){
         printf("#################### Start the Decoding ####################\n");
 
         // Step 2.1 : Declare structure variable
-        DecodeInfo dec_info;
+        DecodeInfo dec_info = {0};
 
         // Step 2.2 : call the read_and_validate_encode_args function, and validate the arguments
         if(read_and_validate_decode_args(argv, &dec_info) == success){
 
             printf("INFO : Sucessfully read and validate the arguments\n");
 
-            //Step 2.2.3 : call do_encoding function
-            if(do_decoding(&dec_info) == success){
+            dec_info.threads = opts.threads;
+            if(opts.key) scatter_key_from_string(opts.key, dec_info.key);
+            dec_info.range = opts.range;
+            dec_info.range_start = opts.range_start;
+            dec_info.range_end = opts.range_end;
+            dec_info.stats = opts.stats ? &stats : NULL;
+
+            //Step 2.2.3 : call do_decoding function, or the mmap one when --mmap is given, or the io_uring one
+            Status status;
+            const char *path;
+            if(stream){
+                path = "stream";
+                status = do_decoding_stream(&dec_info, stream_fd);
+            }
+            else if(opts.socket && !local_only && run_one_job_daemon(e_decode, argv[2], argv[3], NULL, &opts, &status) == success){
+                path = "daemon";
+            }
+            else if(opts.io_uring && !local_only && run_one_job_uring(e_decode, argv[2], argv[3], NULL, &opts, dec_info.stats, &status) == success){
+                path = "io_uring";
+            }
+            else{
+                path = (opts.use_mmap || opts.io_uring) ? "mmap" : "stdio";
+                status = (opts.use_mmap || opts.io_uring) ? do_decoding_mmap(&dec_info) : do_decoding(&dec_info);
+            }
+            stats_print_json(dec_info.stats, stderr, "decode", path, status);
+            stats_close(dec_info.stats);
+            if(status == success){
                 printf("############# Decoding Successfully Completed #############\n");
                 return 0;
             }
@@ -95,6 +276,27 @@ OperationType check_operation_type(char *symbol)
     else if (strcmp(symbol, "-d") == 0){
         return e_decode;
     }
+    else if (strcmp(symbol, "batch") == 0){
+        return e_batch;
+    }
+    else if (strcmp(symbol, "scan") == 0){
+        return e_scan;
+    }
+    else if (strcmp(symbol, "daemon") == 0){
+        return e_daemon;
+    }
+    else if (strcmp(symbol, "stripe") == 0){
+        return e_stripe;
+    }
+    else if (strcmp(symbol, "join") == 0){
+        return e_join;
+    }
+    else if (strcmp(symbol, "index") == 0){
+        return e_index;
+    }
+    else if (strcmp(symbol, "fit") == 0){
+        return e_fit;
+    }
     else{
         return e_unsupported;
     }
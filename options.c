@@ -0,0 +1,105 @@
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "options.h"
+#include "types.h"
+
+/* Remove the options (-k and the "--" ones) from argv, store them into opts and update argc */
+Status parse_options(int *argc, char *argv[], StegoOptions *opts)
+{
+    //Step 1 : Start with the default options
+    memset(opts, 0, sizeof(*opts));
+
+    //Step 2 : Walk through the arguments, keep the positional ones in place
+    int count = 1;
+    for (int i = 1; i < *argc; i++){
+
+        if (strcmp(argv[i], "--mmap") == 0){
+            opts->use_mmap = 1;
+        }
+        else if (strcmp(argv[i], "--in-place") == 0){
+            opts->in_place = 1;
+        }
+        else if (strcmp(argv[i], "--update") == 0){
+            opts->update = 1;
+        }
+        else if (strcmp(argv[i], "--stats") == 0){
+            opts->stats = 1;
+        }
+        else if (strcmp(argv[i], "--socket") == 0){
+            if (i + 1 >= *argc){
+                printf("ERROR : --socket needs the path of the daemon socket\n");
+                return failure;
+            }
+            opts->socket = argv[++i];
+        }
+        else if (strcmp(argv[i], "--key") == 0){
+            if (i + 1 >= *argc || argv[i + 1][0] == '\0'){
+                printf("ERROR : --key needs a passphrase\n");
+                return failure;
+            }
+            opts->key = argv[++i];
+            opts->use_mmap = 1;
+        }
+        else if (strcmp(argv[i], "--chunked") == 0){
+            opts->chunked = 1;
+            opts->use_mmap = 1;
+        }
+        else if (strcmp(argv[i], "--range") == 0){
+            char *end;
+            if (i + 1 >= *argc ||
+                (opts->range_start = strtoull(argv[i + 1], &end, 10), *end != ':') ||
+                (opts->range_end = strtoull(end + 1, &end, 10), *end != '\0') ||
+                opts->range_end <= opts->range_start){
+                printf("ERROR : --range needs a byte range A:B of the secret, with A < B\n");
+                return failure;
+            }
+            i++;
+            opts->range = 1;
+            opts->use_mmap = 1;
+        }
+        else if (strcmp(argv[i], "--io-uring") == 0){
+            opts->io_uring = 1;
+        }
+        else if (strcmp(argv[i], "--compress") == 0){
+            opts->compress = 1;
+            opts->use_mmap = 1;
+        }
+        else if (strcmp(argv[i], "-k") == 0){
+            if (i + 1 >= *argc || (opts->bits = atoi(argv[++i])) < 1 || opts->bits > 4){
+                printf("ERROR : -k needs a number of bits per channel between 1 and 4\n");
+                return failure;
+            }
+            if (opts->bits > 1){
+                opts->use_mmap = 1;
+            }
+        }
+        else if (strcmp(argv[i], "--threads") == 0){
+            if (i + 1 >= *argc || (opts->threads = atoi(argv[++i])) < 1 || opts->threads > MAX_THREADS){
+                printf("ERROR : --threads needs a count between 1 and %d\n", MAX_THREADS);
+                return failure;
+            }
+            opts->use_mmap = 1;
+        }
+        else if (strncmp(argv[i], "--", 2) == 0){
+            printf("ERROR : Unknown option %s\n", argv[i]);
+            return failure;
+        }
+        else{
+            argv[count++] = argv[i];
+        }
+    }
+
+    //Step 3 : The chunks are checked one by one, a compressed stream only as a whole
+    if (opts->chunked && opts->compress){
+        printf("ERROR : --chunked can't be used with --compress\n");
+        return failure;
+    }
+
+    //Step 4 : Terminate the remaining arguments with NULL like the original argv
+    argv[count] = NULL;
+    *argc = count;
+
+    return success;
+}
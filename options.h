@@ -0,0 +1,33 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+/* Header Files */
+#include <stddef.h>
+#include "types.h"
+
+/* Upper limit for --threads */
+#define MAX_THREADS 256
+
+/* Command line options given along with -e / -d */
+typedef struct StegoOptions
+{
+    int use_mmap;   // Use the memory mapped encode/decode path
+    int threads;    // Worker threads (--threads N, implies --mmap), 0 when not given
+    int stats;      // Print per stage timings and I/O counters as JSON on stderr
+    int in_place;   // Embed into the source image itself (--in-place)
+    int update;     // Replace the secret of an existing stego image (--update)
+    int bits;       // LSBs per image byte (-k 1..4, implies --mmap above 1), 0 when not given
+    int compress;   // Compress the secret before embedding (--compress, implies --mmap)
+    int io_uring;   // Do the file I/O on io_uring (--io-uring), the mmap path when it is unavailable
+    char *socket;   // Send the job to the daemon listening there (--socket PATH), NULL when not given
+    char *key;      // Passphrase scattering the secret over the image (--key TEXT, implies --mmap), NULL when not given
+    int chunked;    // Embed the secret as checked chunks with an index (--chunked, implies --mmap)
+    int range;      // Extract only bytes [range_start, range_end) of the secret (--range A:B, implies --mmap)
+    size_t range_start;
+    size_t range_end;
+} StegoOptions;
+
+/* Remove the options (-k and the "--" ones) from argv, store them into opts and update argc */
+Status parse_options(int *argc, char *argv[], StegoOptions *opts);
+
+#endif
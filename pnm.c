@@ -0,0 +1,86 @@
+// Header files
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "pnm.h"
+#include "carrier.h"
+#include "types.h"
+
+/* Skip the white space and the comments, which run from '#' to the end of the line */
+static size_t skip_space(const char *buffer, size_t size, size_t pos){
+
+    while (pos < size){
+        if (buffer[pos] == '#'){
+            while (pos < size && buffer[pos] != '\n' && buffer[pos] != '\r'){
+                pos++;
+            }
+        }
+        else if (buffer[pos] == ' ' || buffer[pos] == '\t' || buffer[pos] == '\n' || buffer[pos] == '\r' ||
+                 buffer[pos] == '\v' || buffer[pos] == '\f'){
+            pos++;
+        }
+        else{
+            break;
+        }
+    }
+    return pos;
+}
+
+/* Read one decimal field after some white space, it has to be followed by more of it */
+static Status read_field(const char *buffer, size_t size, size_t *pos, int *value){
+
+    size_t p = skip_space(buffer, size, *pos);
+    long v = 0;
+
+    if (p == *pos || p >= size || buffer[p] < '0' || buffer[p] > '9'){
+        return failure;
+    }
+    while (p < size && buffer[p] >= '0' && buffer[p] <= '9'){
+        v = v * 10 + (buffer[p++] - '0');
+        if (v > INT_MAX){
+            return failure;
+        }
+    }
+    if (p >= size || skip_space(buffer, size, p) == p){
+        return failure;
+    }
+    *pos = p;
+    *value = (int)v;
+    return success;
+}
+
+/* Parse the header of a binary PGM (P5, 8 bit grey) or PPM (P6, 24 bit RGB) file */
+Status pnm_parse_header(const char *buffer, size_t size, CarrierInfo *pnm){
+
+    size_t pos = 2;
+    int max_value;
+
+    //Step 1 : "P5" or "P6" signature
+    if (size < 3 || buffer[0] != 'P' || (buffer[1] != '5' && buffer[1] != '6')){
+        return failure;
+    }
+
+    //Step 2 : Width, height and largest sample value, as text
+    if (read_field(buffer, size, &pos, &pnm->width) != success ||
+        read_field(buffer, size, &pos, &pnm->height) != success ||
+        read_field(buffer, size, &pos, &max_value) != success){
+        return failure;
+    }
+
+    //Step 3 : Only one byte per sample, two byte samples would put the LSBs on every other byte
+    if (pnm->width <= 0 || pnm->height <= 0 || max_value <= 0 || max_value > PNM_MAX_VALUE){
+        return failure;
+    }
+
+    //Step 4 : A single white space character, then the rows from the top, without padding
+    if (buffer[pos] == '#'){
+        return failure;
+    }
+    pnm->pixel_offset = pos + 1;
+    pnm->bpp = buffer[1] == '5' ? 8 : 24;
+    pnm->extn = buffer[1] == '5' ? ".pgm" : ".ppm";
+    pnm->sample_size = 1;
+    pnm->pixel_size = (size_t)pnm->width * (pnm->bpp / 8) * pnm->height;
+
+    return success;
+}
@@ -0,0 +1,15 @@
+#ifndef PNM_H
+#define PNM_H
+
+/* Header Files */
+#include <stddef.h>
+#include "carrier.h"
+#include "types.h"
+
+/* Largest sample value we accept, one byte per channel */
+#define PNM_MAX_VALUE 255
+
+/* Parse the header of a binary PGM (P5, 8 bit grey) or PPM (P6, 24 bit RGB) file */
+Status pnm_parse_header(const char *buffer, size_t size, CarrierInfo *pnm);
+
+#endif
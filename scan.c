@@ -0,0 +1,311 @@
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "scan.h"
+#include "carrier.h"
+#include "stego.h"
+#include "options.h"
+#include "stats.h"
+#include "types.h"
+
+/* Bounded queue of paths between the walker and the workers */
+typedef struct ScanQueue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    char *paths[SCAN_QUEUE_SIZE];
+    size_t head;
+    size_t tail;
+    int done;                    // The walker has queued every path
+} ScanQueue;
+
+/* Counters of one worker, summed up at the end */
+typedef struct ScanWorker
+{
+    ScanQueue *queue;
+    pthread_mutex_t *print_lock;
+    size_t counts[e_scan_error + 1];
+} ScanWorker;
+
+/* Read exactly size bytes at offset */
+static Status pread_exact(int fd, char *buffer, size_t size, off_t offset){
+
+    while (size > 0){
+        ssize_t n = pread(fd, buffer, size, offset);
+        if (n <= 0){
+            return failure;
+        }
+        buffer += n;
+        size -= n;
+        offset += n;
+    }
+    return success;
+}
+
+/* Check one file, reading only the image header and the stego header bytes */
+ScanResult scan_file(const char *path, StegoHeader *header){
+
+    char samples[STEGO_MAX_HEADER_SIZE * CARRIER_MAX_SAMPLE_SIZE];
+    char pixels[STEGO_MAX_HEADER_SIZE];
+    struct stat st;
+    CarrierInfo carrier;
+
+    //Step 1 : Open, the reads are tiny so read ahead would only waste I/O
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0){
+        return e_scan_error;
+    }
+    if (fstat(fd, &st) != 0){
+        close(fd);
+        return e_scan_error;
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+    //Step 2 : Image header, whatever the format
+    if (carrier_pread_header(fd, &carrier) != success){
+        close(fd);
+        return e_scan_not_carrier;
+    }
+
+    //Step 3 : Only the first pixel bytes (of WAV samples, their first bytes), they hold the magic string, extension and size
+    size_t region = carrier_pixel_region(&carrier, st.st_size) / carrier.sample_size;
+    size_t n = region < sizeof(pixels) ? region : sizeof(pixels);
+    if (pread_exact(fd, samples, n * carrier.sample_size, carrier.pixel_offset) != success){
+        close(fd);
+        return e_scan_error;
+    }
+    close(fd);
+    carrier_gather(&carrier, samples, n, pixels);
+
+    return stego_read_header(pixels, region, header) == success ? e_scan_carrier : e_scan_clean;
+}
+
+/* Queue a path for the workers, waits while the queue is full */
+static void push_path(const char *path, void *arg){
+
+    ScanQueue *queue = arg;
+    char *copy = strdup(path);
+    if (copy == NULL){
+        return;
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->tail - queue->head == SCAN_QUEUE_SIZE){
+        pthread_cond_wait(&queue->not_full, &queue->lock);
+    }
+    queue->paths[queue->tail++ % SCAN_QUEUE_SIZE] = copy;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* Take the next path, NULL once the walker is done and the queue is empty */
+static char *pop_path(ScanQueue *queue){
+
+    char *path = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    while (queue->head == queue->tail && !queue->done){
+        pthread_cond_wait(&queue->not_empty, &queue->lock);
+    }
+    if (queue->head < queue->tail){
+        path = queue->paths[queue->head++ % SCAN_QUEUE_SIZE];
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+
+    return path;
+}
+
+/* Walk a directory, path has room for PATH_MAX bytes. Symbolic links are not followed.
+ * Returns the count of directories that could not be read */
+static size_t walk_directory(char *path, size_t len, void (*visit)(const char *path, void *arg), void *arg){
+
+    DIR *dir = opendir(path);
+    size_t errors = 0;
+    if (dir == NULL){
+        fprintf(stderr, "ERROR : Unable to open directory %s\n", path);
+        return 1;
+    }
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL){
+
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0){
+            continue;
+        }
+        size_t name_len = strlen(entry->d_name);
+        if (len + 1 + name_len >= PATH_MAX){
+            continue;
+        }
+        path[len] = '/';
+        memcpy(path + len + 1, entry->d_name, name_len + 1);
+
+        // d_type saves a stat per entry on the file systems that fill it
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN){
+            struct stat st;
+            type = (lstat(path, &st) != 0) ? DT_UNKNOWN : S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if (type == DT_DIR){
+            errors += walk_directory(path, len + 1 + name_len, visit, arg);
+        }
+        else if (type == DT_REG && carrier_backend_for_name(entry->d_name) != NULL){
+            visit(path, arg);
+        }
+    }
+    path[len] = '\0';
+    closedir(dir);
+    return errors;
+}
+
+/* Call visit for every carrier file (.bmp, .ppm, .pgm, .pnm, .tga, .wav) under the paths, files given by name whatever their extension.
+ * Returns the count of paths and directories that could not be read */
+size_t scan_walk(char *paths[], int count, void (*visit)(const char *path, void *arg), void *arg){
+
+    char path[PATH_MAX];
+    size_t errors = 0;
+
+    for (int i = 0; i < count; i++){
+        struct stat st;
+        if (stat(paths[i], &st) != 0){
+            fprintf(stderr, "ERROR : Unable to find %s\n", paths[i]);
+            errors++;
+        }
+        else if (S_ISDIR(st.st_mode) && strlen(paths[i]) < PATH_MAX){
+            strcpy(path, paths[i]);
+            size_t len = strlen(path);
+            while (len > 1 && path[len - 1] == '/'){
+                path[--len] = '\0';
+            }
+            errors += walk_directory(path, len, visit, arg);
+        }
+        else{
+            visit(paths[i], arg);
+        }
+    }
+    return errors;
+}
+
+static void *scan_worker(void *arg){
+
+    ScanWorker *worker = arg;
+    StegoHeader header = {0};
+    char *path;
+
+    while ((path = pop_path(worker->queue)) != NULL){
+
+        ScanResult result = scan_file(path, &header);
+        worker->counts[result]++;
+
+        if (result == e_scan_carrier || result == e_scan_error){
+            pthread_mutex_lock(worker->print_lock);
+            if (result == e_scan_error){
+                fprintf(stderr, "ERROR : Unable to read %s\n", path);
+            }
+            else if ((header.flags & STEGO_FLAG_STRIPED) && header.stripe.count > 0){
+                printf("%s : k=%d extn=%s size=%zu part=%zu/%zu set=%016llx\n", path, header.bits, header.extn[0] ? header.extn : "-", header.secret_size,
+                       header.stripe.index, header.stripe.count, (unsigned long long)header.stripe.set_id);
+            }
+            else if (header.flags & STEGO_FLAG_SCATTERED){
+                // The original size of a compressed secret is behind the key
+                printf("%s : k=%d extn=%s %s=%zu scattered\n", path, header.bits, header.extn[0] ? header.extn : "-",
+                       (header.flags & STEGO_FLAG_COMPRESSED) ? "compressed" : "size", header.secret_size);
+            }
+            else if (header.flags & STEGO_FLAG_CHUNKED){
+                printf("%s : k=%d extn=%s size=%zu chunks=%zu\n", path, header.bits, header.extn[0] ? header.extn : "-", header.secret_size,
+                       (header.secret_size + header.chunk_size - 1) / header.chunk_size);
+            }
+            else if (header.flags & STEGO_FLAG_COMPRESSED){
+                printf("%s : k=%d extn=%s size=%zu compressed=%zu\n", path, header.bits, header.extn[0] ? header.extn : "-", header.original_size, header.secret_size);
+            }
+            else{
+                printf("%s : k=%d extn=%s size=%zu\n", path, header.bits, header.extn[0] ? header.extn : "-", header.secret_size);
+            }
+            pthread_mutex_unlock(worker->print_lock);
+        }
+        free(path);
+    }
+    return NULL;
+}
+
+/* Walk the paths, check every image file on a pool of worker threads and print the carriers */
+Status do_scan(char *paths[], int count, int threads){
+
+    //Step 1 : Size the pool, the workers mostly wait for reads so several per CPU keep them in flight
+    if (threads <= 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? cpus * SCAN_THREADS_PER_CPU : 1;
+        threads = (threads > MAX_THREADS) ? MAX_THREADS : threads;
+    }
+
+    ScanQueue *queue = calloc(1, sizeof(ScanQueue));
+    ScanWorker workers[threads];
+    pthread_t tids[threads];
+    pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+    if (queue == NULL){
+        printf("ERROR : Out of memory for the scan queue\n");
+        return failure;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+
+    //Step 2 : Start the workers
+    double start = stats_now();
+    int started = 0;
+    size_t walk_errors = 0;
+    for (int w = 0; w < threads; w++){
+        workers[w] = (ScanWorker){ queue, &print_lock, {0} };
+    }
+    for (int w = 0; w < threads; w++){
+        if (pthread_create(&tids[w], NULL, scan_worker, &workers[w]) != 0){
+            break;
+        }
+        started++;
+    }
+
+    //Step 3 : This thread walks, files given by name are checked whatever their extension
+    walk_errors = scan_walk(paths, count, push_path, queue);
+
+    pthread_mutex_lock(&queue->lock);
+    queue->done = 1;
+    pthread_cond_broadcast(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+
+    //Step 4 : A pool that could not start scans on this thread
+    if (started == 0){
+        scan_worker(&workers[0]);
+    }
+    for (int w = 0; w < started; w++){
+        pthread_join(tids[w], NULL);
+    }
+    double wall = stats_now() - start;
+
+    //Step 5 : Summary
+    size_t totals[e_scan_error + 1] = { [e_scan_error] = walk_errors };
+    for (int w = 0; w < threads; w++){
+        for (int r = 0; r <= e_scan_error; r++){
+            totals[r] += workers[w].counts[r];
+        }
+    }
+    size_t files = totals[e_scan_clean] + totals[e_scan_carrier] + totals[e_scan_not_carrier] + totals[e_scan_error];
+    printf("Files : %zu, with a payload : %zu, without : %zu, not a carrier : %zu, unreadable : %zu\n",
+           files, totals[e_scan_carrier], totals[e_scan_clean], totals[e_scan_not_carrier], totals[e_scan_error]);
+    printf("Wall time : %.3f ms, %.0f files/s, %d workers\n", wall * 1e3, wall > 0 ? files / wall : 0.0, threads);
+
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue);
+
+    return totals[e_scan_error] == 0 ? success : failure;
+}
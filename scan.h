@@ -0,0 +1,33 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+/* Header Files */
+#include "types.h"
+#include "stego.h"
+
+/* Paths waiting for a worker, the walker blocks when the queue is full */
+#define SCAN_QUEUE_SIZE 4096
+
+/* Default workers per online CPU, the checks mostly wait on reads */
+#define SCAN_THREADS_PER_CPU 4
+
+/* Outcome of checking one file */
+typedef enum
+{
+    e_scan_clean,       // Carrier without a payload
+    e_scan_carrier,     // Carrier with a valid stego header
+    e_scan_not_carrier, // Not an uncompressed BMP, PPM, PGM or TGA image nor a 16 bit PCM WAV file
+    e_scan_error        // Unable to open or read
+} ScanResult;
+
+/* Check one file, reading only the image header and the stego header bytes */
+ScanResult scan_file(const char *path, StegoHeader *header);
+
+/* Call visit for every carrier file (.bmp, .ppm, .pgm, .pnm, .tga, .wav) under the paths, files given by name whatever their extension.
+ * Returns the count of paths and directories that could not be read */
+size_t scan_walk(char *paths[], int count, void (*visit)(const char *path, void *arg), void *arg);
+
+/* Walk the paths, check every image file on a pool of worker threads and print the carriers */
+Status do_scan(char *paths[], int count, int threads);
+
+#endif
@@ -0,0 +1,181 @@
+// Header files
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "scatter.h"
+#include "lsb.h"
+#include "types.h"
+
+/* Counter based mixer (the splitmix64 finalizer) */
+static uint64_t mix64(uint64_t x){
+
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBull;
+    x ^= x >> 31;
+    return x;
+}
+
+/* Derive the 128 bit key from a passphrase */
+void scatter_key_from_string(const char *text, uint64_t key[2]){
+
+    uint64_t a = 0x6A09E667F3BCC908ull, b = 0xBB67AE8584CAA73Bull;
+
+    for (const unsigned char *p = (const unsigned char *)text; *p != '\0'; p++){
+        a = mix64(a ^ *p);
+        b = mix64(b + a);
+    }
+    key[0] = mix64(a ^ strlen(text));
+    key[1] = mix64(b ^ key[0]);
+}
+
+/* Set up the permutation of a region of region_size pixel bytes */
+void scatter_map_init(ScatterMap *map, const uint64_t key[2], size_t region_size){
+
+    int bits = 0;
+
+    map->key[0] = key[0];
+    map->key[1] = key[1];
+    map->blocks = region_size / SCATTER_BLOCK_SIZE;
+
+    // Smallest even bit count covering the blocks, cycle walking then takes < 4 steps on average
+    while (bits < 64 && ((uint64_t)1 << bits) < map->blocks){
+        bits++;
+    }
+    bits += bits & 1;
+    map->half_bits = bits / 2;
+    map->half_mask = ((uint64_t)1 << map->half_bits) - 1;
+}
+
+/* Physical block of logical block index */
+size_t scatter_block(const ScatterMap *map, size_t index){
+
+    uint64_t x = index;
+
+    if (map->blocks <= 1){
+        return index;
+    }
+
+    // Cycle walking : permute the power of two domain until the result is a real block
+    do{
+        uint64_t left = x >> map->half_bits, right = x & map->half_mask;
+        for (int round = 0; round < SCATTER_ROUNDS; round++){
+            uint64_t f = mix64(map->key[round & 1] + (uint64_t)round * 0x9E3779B97F4A7C15ull + mix64(right ^ map->key[1])) & map->half_mask;
+            uint64_t next = left ^ f;
+            left = right;
+            right = next;
+        }
+        x = (left << map->half_bits) | right;
+    } while (x >= map->blocks);
+
+    return x;
+}
+
+/* Pixel bytes of the region that blocks can use */
+size_t scatter_capacity(size_t region_size){
+
+    return region_size / SCATTER_BLOCK_SIZE * SCATTER_BLOCK_SIZE;
+}
+
+/* A range of logical blocks for one thread */
+typedef struct ScatterStripe
+{
+    const ScatterMap *map;
+    char *data;
+    size_t size;
+    char *region;
+    int bits;
+    size_t first;        // First logical block
+    size_t count;        // Logical blocks
+    int decode;
+} ScatterStripe;
+
+static void *run_scatter_stripe(void *arg){
+
+    ScatterStripe *stripe = arg;
+    size_t per_block = SCATTER_BLOCK_SIZE / 8 * stripe->bits;
+
+    for (size_t i = stripe->first; i < stripe->first + stripe->count; i++){
+        size_t offset = i * per_block;
+        size_t len = (stripe->size - offset < per_block) ? stripe->size - offset : per_block;
+        char *block = stripe->region + scatter_block(stripe->map, i) * SCATTER_BLOCK_SIZE;
+        if (stripe->decode){
+            decode_data_from_lsb_k(stripe->data + offset, len, block, stripe->bits);
+        }
+        else{
+            encode_data_to_lsb_k(stripe->data + offset, len, block, stripe->bits);
+        }
+    }
+    return NULL;
+}
+
+/* Split the logical blocks over threads, the caller takes the first range */
+static Status run_scattered(char *data, size_t size, char *region, size_t region_size, int bits, const uint64_t key[2], int threads, int decode){
+
+    ScatterMap map;
+
+    //Step 1 : Every logical block needs a whole block of the region
+    if (bits < 1 || bits > LSB_MAX_BITS){
+        return failure;
+    }
+    scatter_map_init(&map, key, region_size);
+    size_t per_block = SCATTER_BLOCK_SIZE / 8 * bits;
+    size_t used = (size + per_block - 1) / per_block;
+    if (used > map.blocks){
+        return failure;
+    }
+
+    //Step 2 : Ranges of blocks, no thread for less than LSB_MIN_STRIPE_SIZE of data
+    if ((size_t)threads > size / LSB_MIN_STRIPE_SIZE){
+        threads = size / LSB_MIN_STRIPE_SIZE;
+    }
+    if (threads <= 1){
+        ScatterStripe whole = { &map, data, size, region, bits, 0, used, decode };
+        run_scatter_stripe(&whole);
+        return success;
+    }
+
+    ScatterStripe stripes[threads];
+    pthread_t tids[threads];
+    size_t per_thread = (used + threads - 1) / threads;
+    size_t first = 0;
+    for (int t = 0; t < threads; t++){
+        size_t count = (used - first < per_thread) ? used - first : per_thread;
+        stripes[t] = (ScatterStripe){ &map, data, size, region, bits, first, count, decode };
+        first += count;
+    }
+
+    //Step 3 : Start the workers, on failure the remaining ranges run on this thread
+    int started = 1;
+    for (int t = 1; t < threads; t++){
+        if (pthread_create(&tids[t], NULL, run_scatter_stripe, &stripes[t]) != 0){
+            break;
+        }
+        started++;
+    }
+
+    run_scatter_stripe(&stripes[0]);
+    for (int t = started; t < threads; t++){
+        run_scatter_stripe(&stripes[t]);
+    }
+
+    //Step 4 : Wait for all the workers
+    for (int t = 1; t < started; t++){
+        pthread_join(tids[t], NULL);
+    }
+
+    return success;
+}
+
+/* Encode size bytes at bits LSBs, block by block, the blocks split over threads */
+Status scatter_encode(const char *data, size_t size, char *region, size_t region_size, int bits, const uint64_t key[2], int threads){
+
+    return run_scattered((char *)data, size, region, region_size, bits, key, threads, 0);
+}
+
+/* Decode what scatter_encode wrote */
+Status scatter_decode(char *data, size_t size, const char *region, size_t region_size, int bits, const uint64_t key[2], int threads){
+
+    return run_scattered(data, size, (char *)region, region_size, bits, key, threads, 1);
+}
@@ -0,0 +1,52 @@
+#ifndef SCATTER_H
+#define SCATTER_H
+
+/*
+ * Keyed block scattering (STEGO_FLAG_SCATTERED). The pixel bytes after the
+ * stego header are cut into blocks of SCATTER_BLOCK_SIZE; logical block i
+ * of the LSB stream goes to block scatter_block(i), and stays sequential
+ * inside it. The permutation is a small Feistel network over the block
+ * index with cycle walking, its rounds keyed by a counter based mixer, so
+ * the place of any block is computed on its own, without tables.
+ * It hides where the payload is, it is not encryption.
+ */
+
+/* Header Files */
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/* Pixel bytes per block, a multiple of 8 so it holds whole groups at any depth */
+#define SCATTER_BLOCK_SIZE 4096
+
+/* Feistel rounds of the block permutation */
+#define SCATTER_ROUNDS 4
+
+/* Permutation of the whole blocks of one region */
+typedef struct ScatterMap
+{
+    uint64_t key[2];
+    size_t blocks;       // Whole blocks in the region
+    int half_bits;       // Bits of each Feistel half
+    uint64_t half_mask;
+} ScatterMap;
+
+/* Derive the 128 bit key from a passphrase */
+void scatter_key_from_string(const char *text, uint64_t key[2]);
+
+/* Set up the permutation of a region of region_size pixel bytes */
+void scatter_map_init(ScatterMap *map, const uint64_t key[2], size_t region_size);
+
+/* Physical block of logical block index */
+size_t scatter_block(const ScatterMap *map, size_t index);
+
+/* Pixel bytes of the region that blocks can use */
+size_t scatter_capacity(size_t region_size);
+
+/* Encode size bytes at bits LSBs, block by block, the blocks split over threads */
+Status scatter_encode(const char *data, size_t size, char *region, size_t region_size, int bits, const uint64_t key[2], int threads);
+
+/* Decode what scatter_encode wrote */
+Status scatter_decode(char *data, size_t size, const char *region, size_t region_size, int bits, const uint64_t key[2], int threads);
+
+#endif
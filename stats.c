@@ -0,0 +1,155 @@
+// Header files
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "stats.h"
+#include "types.h"
+
+/* Monotonic time in seconds */
+double stats_now(void){
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Take the counters of the calling thread */
+static void take_snapshot(const StegoStats *stats, StatsSnapshot *snap){
+
+    memset(snap, 0, sizeof(*snap));
+    snap->time = stats_now();
+
+#ifdef RUSAGE_THREAD
+    struct rusage usage;
+    if (getrusage(RUSAGE_THREAD, &usage) == 0){
+        snap->faults = usage.ru_minflt + usage.ru_majflt;
+    }
+#endif
+
+    // rchar, wchar, syscr and syscw of /proc/thread-self/io
+    char buffer[512];
+    ssize_t n;
+    if (stats->io_fd < 0 || (n = pread(stats->io_fd, buffer, sizeof(buffer) - 1, 0)) <= 0){
+        return;
+    }
+    buffer[n] = '\0';
+    snap->proc_read = n;
+
+    for (char *line = strtok(buffer, "\n"); line != NULL; line = strtok(NULL, "\n")){
+        unsigned long long value;
+        char key[32];
+        if (sscanf(line, "%31[^:]: %llu", key, &value) != 2){
+            continue;
+        }
+        if (strcmp(key, "rchar") == 0) snap->rchar = value;
+        else if (strcmp(key, "wchar") == 0) snap->wchar = value;
+        else if (strcmp(key, "syscr") == 0) snap->syscr = value;
+        else if (strcmp(key, "syscw") == 0) snap->syscw = value;
+    }
+}
+
+/* Difference of two counters, less what taking the snapshot added */
+static unsigned long long delta(unsigned long long end, unsigned long long start, unsigned long long overhead){
+
+    return (end - start > overhead) ? end - start - overhead : 0;
+}
+
+/* Prepare the counters */
+void stats_init(StegoStats *stats){
+
+    if (stats == NULL){
+        return;
+    }
+    memset(stats, 0, sizeof(*stats));
+    stats->io_fd = open("/proc/thread-self/io", O_RDONLY);
+}
+
+/* End the running stage */
+void stats_finish(StegoStats *stats){
+
+    if (stats == NULL || !stats->open_stage){
+        return;
+    }
+
+    StatsSnapshot now;
+    take_snapshot(stats, &now);
+
+    StatsStage *stage = &stats->stages[stats->count - 1];
+    stage->seconds = now.time - stats->stage_start.time;
+    // The pread of the first snapshot is counted by the kernel after it made the text, take it out
+    unsigned long long proc_calls = (stats->stage_start.proc_read > 0);
+    stage->bytes_read = delta(now.rchar, stats->stage_start.rchar, stats->stage_start.proc_read);
+    stage->bytes_written = delta(now.wchar, stats->stage_start.wchar, 0);
+    stage->read_syscalls = delta(now.syscr, stats->stage_start.syscr, proc_calls);
+    stage->write_syscalls = delta(now.syscw, stats->stage_start.syscw, 0);
+    stage->page_faults = now.faults - stats->stage_start.faults;
+    stats->open_stage = 0;
+}
+
+/* End the running stage, if any, and start a new one */
+void stats_stage(StegoStats *stats, const char *name){
+
+    if (stats == NULL){
+        return;
+    }
+    stats_finish(stats);
+    if (stats->count == STATS_MAX_STAGES){
+        return;
+    }
+
+    stats->stages[stats->count].name = name;
+    stats->count++;
+    take_snapshot(stats, &stats->stage_start);
+    stats->open_stage = 1;
+}
+
+/* Print everything as one JSON object */
+void stats_print_json(StegoStats *stats, FILE *out, const char *operation, const char *path, Status status){
+
+    if (stats == NULL){
+        return;
+    }
+    stats_finish(stats);
+
+    StatsStage total = { "total", 0, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < stats->count; i++){
+        total.seconds += stats->stages[i].seconds;
+        total.bytes_read += stats->stages[i].bytes_read;
+        total.bytes_written += stats->stages[i].bytes_written;
+        total.read_syscalls += stats->stages[i].read_syscalls;
+        total.write_syscalls += stats->stages[i].write_syscalls;
+        total.page_faults += stats->stages[i].page_faults;
+    }
+
+    fprintf(out, "{\"operation\":\"%s\",\"path\":\"%s\",\"status\":\"%s\",\"io_counters\":%s,\"stages\":[",
+            operation, path, status == success ? "success" : "failure", stats->io_fd >= 0 ? "true" : "false");
+
+    for (int i = 0; i <= stats->count; i++){
+        const StatsStage *stage = (i < stats->count) ? &stats->stages[i] : &total;
+        if (i == stats->count){
+            fprintf(out, "],\"total\":");
+        }
+        else if (i > 0){
+            fprintf(out, ",");
+        }
+        fprintf(out, "{\"name\":\"%s\",\"seconds\":%.9f,\"bytes_read\":%llu,\"bytes_written\":%llu,"
+                     "\"read_syscalls\":%llu,\"write_syscalls\":%llu,\"page_faults\":%ld}",
+                stage->name, stage->seconds, stage->bytes_read, stage->bytes_written,
+                stage->read_syscalls, stage->write_syscalls, stage->page_faults);
+    }
+    fprintf(out, "}\n");
+}
+
+/* Release the counters */
+void stats_close(StegoStats *stats){
+
+    if (stats != NULL && stats->io_fd >= 0){
+        close(stats->io_fd);
+        stats->io_fd = -1;
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef STATS_H
+#define STATS_H
+
+/* Header Files */
+#include <stdio.h>
+#include "types.h"
+
+/* Most stages one encode or decode goes through */
+#define STATS_MAX_STAGES 16
+
+/* Counters of one stage */
+typedef struct StatsStage
+{
+    const char *name;                   // Name of the step, e.g. "magic"
+    double seconds;                     // Monotonic wall time
+    unsigned long long bytes_read;      // Bytes read by read-like syscalls
+    unsigned long long bytes_written;   // Bytes written by write-like syscalls
+    unsigned long long read_syscalls;   // Read-like syscalls
+    unsigned long long write_syscalls;  // Write-like syscalls
+    long page_faults;                   // Minor + major page faults (mmap path I/O)
+} StatsStage;
+
+/* Raw counters at one point in time */
+typedef struct StatsSnapshot
+{
+    double time;
+    unsigned long long rchar, wchar, syscr, syscw;
+    unsigned long long proc_read;       // Bytes of the /proc read itself, counted in rchar
+    long faults;
+} StatsSnapshot;
+
+/* Stats of one encode or decode job (--stats), all the calls accept NULL */
+typedef struct StegoStats
+{
+    int io_fd;                          // /proc/thread-self/io, -1 when not available
+    StatsSnapshot stage_start;          // Counters when the current stage began
+    int open_stage;                     // A stage is running
+    int count;
+    StatsStage stages[STATS_MAX_STAGES];
+} StegoStats;
+
+/* Monotonic time in seconds, also the clock of the batch, scan and daemon timings */
+double stats_now(void);
+
+/* Prepare the counters */
+void stats_init(StegoStats *stats);
+
+/* End the running stage, if any, and start a new one */
+void stats_stage(StegoStats *stats, const char *name);
+
+/* End the running stage */
+void stats_finish(StegoStats *stats);
+
+/* Print everything as one JSON object */
+void stats_print_json(StegoStats *stats, FILE *out, const char *operation, const char *path, Status status);
+
+/* Release the counters */
+void stats_close(StegoStats *stats);
+
+#endif
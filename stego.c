@@ -0,0 +1,1037 @@
+// Header files
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "stego.h"
+#include "lsb.h"
+#include "compress.h"
+#include "scatter.h"
+#include "types.h"
+#include "common.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define STEGO_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+/* Size of the fields after the magic string / format word : extn size, extn, secret size */
+#define FIELDS_SIZE(extn_size, size_width) (4 + (extn_size) + (size_width))
+
+/* Top bit of a block size in the compressed stream, the block is stored as is */
+#define STORED_BLOCK 0x80000000u
+
+/* Reflected polynomial of the CRC-32C in the chunk index, the one of the SSE4.2 crc32 instruction */
+#define CRC32C_POLY 0x82F63B78u
+
+/* Writes a byte stream at k LSBs, bytes that don't fill a group of k wait in carry */
+typedef struct LsbWriter
+{
+    char *base;                  // First pixel byte of the stream
+    size_t pos;                  // Stream offset of the next pixel byte, at the start of a group
+    size_t limit;                // Pixel bytes the stream may use
+    const ScatterMap *map;       // Block permutation, NULL when sequential
+    int bits;                    // LSBs per pixel byte
+    char carry[LSB_MAX_BITS];    // Bytes of the group not written yet
+    int carry_len;
+    size_t size;                 // Bytes written so far
+} LsbWriter;
+
+/* Reads a byte stream back, the rest of a decoded group waits in group */
+typedef struct LsbReader
+{
+    const char *base;            // First pixel byte of the stream
+    size_t pos;                  // Stream offset of the next pixel byte, at the start of a group
+    const ScatterMap *map;       // Block permutation, NULL when sequential
+    size_t left;                 // Bytes of the stream not read yet
+    int bits;                    // LSBs per pixel byte
+    char group[LSB_MAX_BITS];    // Last decoded group
+    int group_pos;
+    int group_len;
+} LsbReader;
+
+/* Store a 32 bit value, little endian */
+static void put_u32(size_t value, char *bytes){
+
+    for (int i = 0; i < 4; i++){
+        bytes[i] = (value >> (i * 8)) & 0xFF;
+    }
+}
+
+/* Read a 32 bit value back */
+static size_t get_u32(const char *bytes){
+
+    const unsigned char *b = (const unsigned char *)bytes;
+    return (size_t)b[0] | ((size_t)b[1] << 8) | ((size_t)b[2] << 16) | ((size_t)b[3] << 24);
+}
+
+/* Store a 64 bit value, little endian */
+static void put_u64(uint64_t value, char *bytes){
+
+    put_u32(value & 0xFFFFFFFFu, bytes);
+    put_u32(value >> 32, bytes + 4);
+}
+
+/* Read a 64 bit value back */
+static uint64_t get_u64(const char *bytes){
+
+    return (uint64_t)get_u32(bytes) | ((uint64_t)get_u32(bytes + 4) << 32);
+}
+
+/* Bytes of a size field, 8 in the wide layout */
+static size_t size_width(const StegoHeader *header){
+
+    return (header->flags & STEGO_FLAG_WIDE) ? 8 : 4;
+}
+
+/* Largest size the size fields hold */
+static size_t max_size(const StegoHeader *header){
+
+    return (header->flags & STEGO_FLAG_WIDE) ? STEGO_MAX_WIDE_SIZE : STEGO_MAX_FIELD_SIZE;
+}
+
+/* Store a size field, 32 or 64 bits */
+static void put_size(const StegoHeader *header, size_t value, char *bytes){
+
+    if (header->flags & STEGO_FLAG_WIDE){
+        put_u64(value, bytes);
+    }
+    else{
+        put_u32(value, bytes);
+    }
+}
+
+/* Read a size field back */
+static size_t get_size(const StegoHeader *header, const char *bytes){
+
+    return (header->flags & STEGO_FLAG_WIDE) ? get_u64(bytes) : get_u32(bytes);
+}
+
+/* The classic layout is kept whenever the extended one is not needed */
+static int is_classic(const StegoHeader *header){
+
+    return header->bits == 1 && header->flags == 0;
+}
+
+/* Pixel bytes used by the magic string, and by the format word in the extended layout */
+static size_t prefix_size(const StegoHeader *header){
+
+    return strlen(MAGIC_STRING) * 8 + (is_classic(header) ? 0 : 32);
+}
+
+/* Pixel byte at stream offset pos, through the block permutation when scattered */
+static size_t stream_offset(size_t pos, const ScatterMap *map){
+
+    if (map == NULL){
+        return pos;
+    }
+    return scatter_block(map, pos / SCATTER_BLOCK_SIZE) * SCATTER_BLOCK_SIZE + pos % SCATTER_BLOCK_SIZE;
+}
+
+/* Encode or decode size bytes from stream offset pos (a group start), split where the blocks end */
+static void stream_transfer(char *base, size_t pos, const ScatterMap *map, char *data, size_t size, int bits, int decode){
+
+    while (size > 0){
+        size_t image = lsb_image_size(size, bits);
+        size_t len = size;
+        if (map != NULL && image > SCATTER_BLOCK_SIZE - pos % SCATTER_BLOCK_SIZE){
+            image = SCATTER_BLOCK_SIZE - pos % SCATTER_BLOCK_SIZE;
+            len = image / 8 * bits;
+        }
+        if (decode){
+            decode_data_from_lsb_k(data, len, base + stream_offset(pos, map), bits);
+        }
+        else{
+            encode_data_to_lsb_k(data, len, base + stream_offset(pos, map), bits);
+        }
+        data += len;
+        size -= len;
+        pos += image;
+    }
+}
+
+/* Append n bytes to the stream */
+static Status writer_put(LsbWriter *w, const char *data, size_t n){
+
+    w->size += n;
+
+    //Step 1 : Complete the group started by the last call
+    if (w->carry_len > 0){
+        size_t take = (size_t)(w->bits - w->carry_len) < n ? (size_t)(w->bits - w->carry_len) : n;
+        memcpy(w->carry + w->carry_len, data, take);
+        w->carry_len += take;
+        data += take;
+        n -= take;
+        if (w->carry_len < w->bits){
+            return success;
+        }
+        if (w->limit - w->pos < 8){
+            return failure;
+        }
+        stream_transfer(w->base, w->pos, w->map, w->carry, w->bits, w->bits, 0);
+        w->pos += 8;
+        w->carry_len = 0;
+    }
+
+    //Step 2 : Whole groups go straight to the pixels, the rest waits
+    size_t whole = n / w->bits * w->bits;
+    size_t image = whole / w->bits * 8;
+    if (image > w->limit - w->pos){
+        return failure;
+    }
+    stream_transfer(w->base, w->pos, w->map, (char *)data, whole, w->bits, 0);
+    w->pos += image;
+    memcpy(w->carry, data + whole, n - whole);
+    w->carry_len = n - whole;
+
+    return success;
+}
+
+/* Write the last, partial group */
+static Status writer_flush(LsbWriter *w){
+
+    if (w->carry_len == 0){
+        return success;
+    }
+    if (lsb_image_size(w->carry_len, w->bits) > w->limit - w->pos){
+        return failure;
+    }
+    stream_transfer(w->base, w->pos, w->map, w->carry, w->carry_len, w->bits, 0);
+    w->carry_len = 0;
+    return success;
+}
+
+/* Read the next n bytes of the stream */
+static Status reader_get(LsbReader *r, char *out, size_t n){
+
+    if (n > r->left){
+        return failure;
+    }
+    r->left -= n;
+
+    //Step 1 : What is left of the last group
+    while (r->group_pos < r->group_len && n > 0){
+        *out++ = r->group[r->group_pos++];
+        n--;
+    }
+
+    //Step 2 : Whole groups straight from the pixels
+    size_t whole = n / r->bits * r->bits;
+    stream_transfer((char *)r->base, r->pos, r->map, out, whole, r->bits, 1);
+    r->pos += whole / r->bits * 8;
+
+    //Step 3 : Decode one more group for the rest, it may be the short last one
+    size_t rest = n - whole;
+    if (rest > 0){
+        size_t group_len = rest + r->left < (size_t)r->bits ? rest + r->left : (size_t)r->bits;
+        stream_transfer((char *)r->base, r->pos, r->map, r->group, group_len, r->bits, 1);
+        r->pos += 8;
+        memcpy(out + whole, r->group, rest);
+        r->group_pos = rest;
+        r->group_len = group_len;
+    }
+
+    return success;
+}
+
+/* Compress the secret block by block into the stream */
+static Status embed_compressed(LsbWriter *w, const StegoHeader *header, const char *secret, size_t size, void *scratch){
+
+    char *memory = (scratch != NULL) ? scratch : malloc(STEGO_SCRATCH_SIZE);
+    uint32_t *hash_table = (uint32_t *)memory;
+    char *block = memory + COMPRESS_HASH_SIZE * sizeof(uint32_t);
+    char word[8];
+    Status status = (memory != NULL) ? success : failure;
+
+    //Step 1 : Original size
+    put_size(header, size, word);
+    if (status == success){
+        status = writer_put(w, word, size_width(header));
+    }
+
+    //Step 2 : Each block with its size, stored as is when it doesn't shrink
+    for (size_t offset = 0; offset < size && status == success; offset += COMPRESS_BLOCK_SIZE){
+        size_t chunk = size - offset < COMPRESS_BLOCK_SIZE ? size - offset : COMPRESS_BLOCK_SIZE;
+        size_t packed = lz_compress_block(secret + offset, chunk, block, COMPRESS_BOUND(COMPRESS_BLOCK_SIZE), hash_table);
+
+        put_u32(packed ? packed : (chunk | STORED_BLOCK), word);
+        status = writer_put(w, word, 4);
+        if (status == success){
+            status = packed ? writer_put(w, block, packed) : writer_put(w, secret + offset, chunk);
+        }
+    }
+    if (status == success){
+        status = writer_flush(w);
+    }
+
+    if (scratch == NULL){
+        free(memory);
+    }
+    return status;
+}
+
+/* Decompress the stream block by block into the secret */
+static Status extract_compressed(LsbReader *r, const StegoHeader *header, char *secret, size_t size, void *scratch){
+
+    char *block = (scratch != NULL) ? scratch : malloc(COMPRESS_BOUND(COMPRESS_BLOCK_SIZE));
+    char word[8];
+    size_t produced = 0;
+    Status status = block != NULL ? reader_get(r, word, size_width(header)) : failure;
+
+    //Step 1 : The original size has been read by stego_read_header already
+    if (status == success && get_size(header, word) != size){
+        status = failure;
+    }
+
+    //Step 2 : Blocks until the original size is reached
+    while (produced < size && status == success){
+        size_t room = size - produced < COMPRESS_BLOCK_SIZE ? size - produced : COMPRESS_BLOCK_SIZE;
+        size_t length, unpacked = 0;
+
+        status = reader_get(r, word, 4);
+        length = get_u32(word) & ~(size_t)STORED_BLOCK;
+        if (status != success){
+            break;
+        }
+        if (get_u32(word) & STORED_BLOCK){
+            status = length <= room ? reader_get(r, secret + produced, length) : failure;
+            unpacked = length;
+        }
+        else if (length > COMPRESS_BOUND(COMPRESS_BLOCK_SIZE) || reader_get(r, block, length) != success){
+            status = failure;
+        }
+        else{
+            status = lz_decompress_block(block, length, secret + produced, room, &unpacked);
+        }
+        if (unpacked == 0){
+            status = failure;
+        }
+        produced += unpacked;
+    }
+
+    if (scratch == NULL){
+        free(block);
+    }
+    return status;
+}
+
+/* CRC-32C table for CPUs without the crc32 instruction, filled once with the CPU check */
+static uint32_t crc_table[256];
+static int crc_have_sse42;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_init(void){
+
+    for (uint32_t i = 0; i < 256; i++){
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++){
+            c = (c & 1) ? CRC32C_POLY ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+#ifdef STEGO_HAVE_X86
+    __builtin_cpu_init();
+    crc_have_sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#ifdef STEGO_HAVE_X86
+/* 8 bytes per crc32 instruction */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t size){
+
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, p += 8){
+        uint64_t word;
+        memcpy(&word, p, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = (uint32_t)crc64;
+    for (; size > 0; size--, p++){
+        crc = _mm_crc32_u8(crc, *p);
+    }
+    return crc;
+}
+#endif
+
+/* CRC-32C of a chunk, as stored in its index entry */
+static uint32_t chunk_crc32(const char *data, size_t size){
+
+    const unsigned char *p = (const unsigned char *)data;
+    uint32_t crc = 0xFFFFFFFFu;
+
+    pthread_once(&crc_once, crc_init);
+#ifdef STEGO_HAVE_X86
+    if (crc_have_sse42){
+        return ~crc32c_sse42(crc, p, size);
+    }
+#endif
+    for (size_t i = 0; i < size; i++){
+        crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/* Chunks of a chunked secret */
+static size_t chunk_count(const StegoHeader *header){
+
+    return header->chunk_size ? (header->secret_size + header->chunk_size - 1) / header->chunk_size : 0;
+}
+
+/* Secret bytes of chunk i, the last one may be short */
+static size_t chunk_length(const StegoHeader *header, size_t i){
+
+    size_t rest = header->secret_size - i * header->chunk_size;
+    return rest < header->chunk_size ? rest : header->chunk_size;
+}
+
+/* Pixel bytes of size bytes rounded up to whole groups, so the next data starts a group */
+static size_t group_image_size(size_t size, int bits){
+
+    return (size + bits - 1) / bits * 8;
+}
+
+/* Bytes of an index entry */
+static size_t entry_size(const StegoHeader *header){
+
+    return (header->flags & STEGO_FLAG_WIDE) ? STEGO_INDEX_WIDE_ENTRY_SIZE : STEGO_INDEX_ENTRY_SIZE;
+}
+
+/* Stream offset of chunk i, after the index and the chunks before it */
+static size_t chunk_offset(const StegoHeader *header, size_t i){
+
+    size_t index = STEGO_INDEX_HEADER_SIZE + chunk_count(header) * entry_size(header);
+    return group_image_size(index, header->bits) + i * group_image_size(header->chunk_size, header->bits);
+}
+
+/* Stream offset of the index entry of chunk i, the entries are whole groups at any depth */
+static size_t entry_offset(const StegoHeader *header, size_t i){
+
+    return (STEGO_INDEX_HEADER_SIZE + i * entry_size(header)) / header->bits * 8;
+}
+
+/* Bytes of the record of a striped part */
+static size_t record_size(const StegoHeader *header){
+
+    return (header->flags & STEGO_FLAG_WIDE) ? STEGO_STRIPE_WIDE_RECORD_SIZE : STEGO_STRIPE_RECORD_SIZE;
+}
+
+/* Pixel bytes used by the header fields */
+size_t stego_header_size(const StegoHeader *header){
+
+    return prefix_size(header) + lsb_image_size(FIELDS_SIZE(strlen(header->extn), size_width(header)), header->bits);
+}
+
+/* Pixel bytes taken by a stream of image pixel bytes, whole blocks when scattered */
+static size_t region_image_size(const StegoHeader *header, size_t image){
+
+    if (header->flags & STEGO_FLAG_SCATTERED){
+        image = (image + SCATTER_BLOCK_SIZE - 1) / SCATTER_BLOCK_SIZE * SCATTER_BLOCK_SIZE;
+    }
+    return image;
+}
+
+/* Stream offset of the secret, after the record of a striped part */
+static size_t part_offset(const StegoHeader *header){
+
+    return (header->flags & STEGO_FLAG_STRIPED) ? group_image_size(record_size(header), header->bits) : 0;
+}
+
+/* Pixel bytes taken by size bytes of data, the index and the chunks when chunked */
+static size_t data_image_size(const StegoHeader *header, size_t size){
+
+    if (!(header->flags & STEGO_FLAG_CHUNKED)){
+        return region_image_size(header, part_offset(header) + lsb_image_size(size, header->bits));
+    }
+    size_t count = chunk_count(header);
+    if (count == 0){
+        return region_image_size(header, lsb_image_size(STEGO_INDEX_HEADER_SIZE, header->bits));
+    }
+    return region_image_size(header, chunk_offset(header, count - 1) + lsb_image_size(chunk_length(header, count - 1), header->bits));
+}
+
+/* Chunks handled by one thread, and the part of the secret they cover */
+typedef struct ChunkStripe
+{
+    char *base;                  // First pixel byte of the stream
+    const ScatterMap *map;       // Block permutation, NULL when sequential
+    size_t limit;                // Pixel bytes the stream may use
+    const StegoHeader *header;
+    char *secret;                // The whole secret (embed), or bytes [lo, hi) of it (extract)
+    size_t lo;
+    size_t hi;
+    size_t first;                // First chunk
+    size_t count;                // Chunks
+    int decode;
+    Status status;
+} ChunkStripe;
+
+/* Embed the chunks of a stripe with their index entries */
+static void embed_chunks(ChunkStripe *stripe){
+
+    const StegoHeader *header = stripe->header;
+    size_t width = size_width(header);
+    char entry[STEGO_INDEX_WIDE_ENTRY_SIZE] = {0};
+
+    for (size_t i = stripe->first; i < stripe->first + stripe->count; i++){
+        const char *chunk = stripe->secret + i * header->chunk_size;
+        size_t length = chunk_length(header, i);
+        size_t offset = chunk_offset(header, i);
+
+        stream_transfer(stripe->base, offset, stripe->map, (char *)chunk, length, header->bits, 0);
+        put_size(header, offset, entry);
+        put_size(header, length, entry + width);
+        put_u32(chunk_crc32(chunk, length), entry + 2 * width);
+        stream_transfer(stripe->base, entry_offset(header, i), stripe->map, entry, entry_size(header), header->bits, 0);
+    }
+}
+
+/* Extract and check the chunks of a stripe, only their part inside [lo, hi) is kept */
+static void extract_chunks(ChunkStripe *stripe){
+
+    const StegoHeader *header = stripe->header;
+    size_t width = size_width(header);
+    char entry[STEGO_INDEX_WIDE_ENTRY_SIZE];
+    char *partial = NULL;
+
+    for (size_t i = stripe->first; i < stripe->first + stripe->count && stripe->status == success; i++){
+
+        //Step 1 : The index entry has to describe chunk i inside the stream
+        stream_transfer(stripe->base, entry_offset(header, i), stripe->map, entry, entry_size(header), header->bits, 1);
+        size_t offset = get_size(header, entry);
+        size_t length = get_size(header, entry + width);
+        uint32_t crc = get_u32(entry + 2 * width);
+        if (length != chunk_length(header, i) || offset % 8 != 0 || offset < chunk_offset(header, 0) ||
+            offset > stripe->limit || lsb_image_size(length, header->bits) > stripe->limit - offset){
+            stripe->status = failure;
+            break;
+        }
+
+        //Step 2 : A chunk inside the range is extracted in place, one cut by it into a buffer
+        size_t start = i * header->chunk_size;
+        size_t from = start > stripe->lo ? start : stripe->lo;
+        size_t to = start + length < stripe->hi ? start + length : stripe->hi;
+        char *chunk;
+        if (from != start || to != start + length){
+            if (partial == NULL && (partial = malloc(header->chunk_size)) == NULL){
+                stripe->status = failure;
+                break;
+            }
+            chunk = partial;
+        }
+        else{
+            chunk = stripe->secret + (start - stripe->lo);
+        }
+        stream_transfer(stripe->base, offset, stripe->map, chunk, length, header->bits, 1);
+
+        //Step 3 : Check it before it is used
+        if (chunk_crc32(chunk, length) != crc){
+            stripe->status = failure;
+            break;
+        }
+        if (chunk == partial){
+            memcpy(stripe->secret + (from - stripe->lo), partial + (from - start), to - from);
+        }
+    }
+    free(partial);
+}
+
+static void *run_chunk_stripe(void *arg){
+
+    ChunkStripe *stripe = arg;
+    if (stripe->decode){
+        extract_chunks(stripe);
+    }
+    else{
+        embed_chunks(stripe);
+    }
+    return NULL;
+}
+
+/* Split chunks [first, first + count) over threads, the caller takes the first range */
+static Status run_chunked(ChunkStripe *whole, int threads){
+
+    //Step 1 : No thread for less than LSB_MIN_STRIPE_SIZE of data, nor without a chunk
+    size_t bytes = whole->count * whole->header->chunk_size;
+    if ((size_t)threads > bytes / LSB_MIN_STRIPE_SIZE){
+        threads = bytes / LSB_MIN_STRIPE_SIZE;
+    }
+    if ((size_t)threads > whole->count){
+        threads = whole->count;
+    }
+    whole->status = success;
+    if (threads <= 1){
+        run_chunk_stripe(whole);
+        return whole->status;
+    }
+
+    ChunkStripe stripes[threads];
+    pthread_t tids[threads];
+    size_t per_thread = (whole->count + threads - 1) / threads;
+    size_t first = whole->first;
+    for (int t = 0; t < threads; t++){
+        size_t left = whole->first + whole->count - first;
+        stripes[t] = *whole;
+        stripes[t].first = first;
+        stripes[t].count = left < per_thread ? left : per_thread;
+        first += stripes[t].count;
+    }
+
+    //Step 2 : Start the workers, on failure the remaining ranges run on this thread
+    int started = 1;
+    for (int t = 1; t < threads; t++){
+        if (pthread_create(&tids[t], NULL, run_chunk_stripe, &stripes[t]) != 0){
+            break;
+        }
+        started++;
+    }
+
+    run_chunk_stripe(&stripes[0]);
+    for (int t = started; t < threads; t++){
+        run_chunk_stripe(&stripes[t]);
+    }
+
+    //Step 3 : Wait for all the workers, any bad chunk fails the whole
+    Status status = success;
+    for (int t = 0; t < threads; t++){
+        if (t > 0 && t < started){
+            pthread_join(tids[t], NULL);
+        }
+        if (stripes[t].status != success){
+            status = failure;
+        }
+    }
+    return status;
+}
+
+/* A key of zero means the caller has none */
+static int has_key(const StegoHeader *header){
+
+    return header->key[0] != 0 || header->key[1] != 0;
+}
+
+/* Pixel bytes needed for the header and the secret */
+size_t stego_required_size(const StegoHeader *header){
+
+    return stego_header_size(header) + data_image_size(header, header->secret_size);
+}
+
+/* Most pixel bytes stego_embed can use, the compressed size is only known once embedded */
+size_t stego_embed_bound(const StegoHeader *header){
+
+    if (!(header->flags & STEGO_FLAG_COMPRESSED)){
+        return stego_required_size(header);
+    }
+
+    // Blocks that don't shrink are stored, so only the sizes are added
+    size_t blocks = (header->original_size + COMPRESS_BLOCK_SIZE - 1) / COMPRESS_BLOCK_SIZE;
+    return stego_header_size(header) + data_image_size(header, size_width(header) + blocks * 4 + header->original_size);
+}
+
+/* Set STEGO_FLAG_WIDE when a size of the header doesn't fit the 32 bit fields. The index entries
+ * of a chunked secret hold pixel stream offsets, up to 8 times the secret and its index */
+void stego_fit_fields(StegoHeader *header){
+
+    if (header->secret_size > STEGO_MAX_FIELD_SIZE || header->original_size > STEGO_MAX_FIELD_SIZE ||
+        ((header->flags & STEGO_FLAG_STRIPED) && header->stripe.total_size > STEGO_MAX_FIELD_SIZE) ||
+        ((header->flags & STEGO_FLAG_CHUNKED) && header->secret_size > STEGO_MAX_FIELD_SIZE / 16)){
+        header->flags |= STEGO_FLAG_WIDE;
+    }
+}
+
+/* Embed only the header into the first stego_header_size pixel bytes, in place */
+Status stego_embed_header(char *pixels, size_t pixels_size, const StegoHeader *header){
+
+    size_t extn_size = strlen(header->extn);
+    char fields[FIELDS_SIZE(MAX_EXTN_SIZE, 8)];
+
+    if (extn_size > MAX_EXTN_SIZE || header->bits < 1 || header->bits > LSB_MAX_BITS ||
+        (header->flags & ~STEGO_KNOWN_FLAGS) != 0 || header->secret_size > max_size(header) ||
+        stego_header_size(header) > pixels_size){
+        return failure;
+    }
+
+    //Step 1 : Magic string, and the format word for the extended layout
+    if (is_classic(header)){
+        encode_data_to_lsb(MAGIC_STRING, strlen(MAGIC_STRING), pixels);
+    }
+    else{
+        char format[4];
+        put_u32(header->bits | (header->flags << STEGO_FORMAT_FLAGS_SHIFT), format);
+        encode_data_to_lsb(MAGIC_STRING_EXT, strlen(MAGIC_STRING_EXT), pixels);
+        encode_data_to_lsb(format, 4, pixels + strlen(MAGIC_STRING_EXT) * 8);
+    }
+
+    //Step 2 : Extension size, extension and secret size
+    put_u32(extn_size, fields);
+    memcpy(fields + 4, header->extn, extn_size);
+    put_size(header, header->secret_size, fields + 4 + extn_size);
+    encode_data_to_lsb_k(fields, FIELDS_SIZE(extn_size, size_width(header)), pixels + prefix_size(header), header->bits);
+
+    return success;
+}
+
+/* Embed the header and the secret into the pixels, in place */
+Status stego_embed(char *pixels, size_t pixels_size, StegoHeader *header, const char *secret, int threads, void *scratch){
+
+    size_t extn_size = strlen(header->extn);
+    int compressed = (header->flags & STEGO_FLAG_COMPRESSED) != 0;
+    int scattered = (header->flags & STEGO_FLAG_SCATTERED) != 0;
+    int chunked = (header->flags & STEGO_FLAG_CHUNKED) != 0;
+    int striped = (header->flags & STEGO_FLAG_STRIPED) != 0;
+    const StegoStripe *stripe = &header->stripe;
+
+    //Step 1 : Everything has to fit into the fields and the pixels, the compressed size is checked as it grows
+    stego_fit_fields(header);
+    size_t limit = max_size(header);
+    if (extn_size > MAX_EXTN_SIZE || header->bits < 1 || header->bits > LSB_MAX_BITS ||
+        (header->flags & ~STEGO_KNOWN_FLAGS) != 0 || (scattered && !has_key(header)) ||
+        (chunked && (compressed || header->chunk_size == 0 || header->chunk_size > STEGO_MAX_FIELD_SIZE ||
+                     header->secret_size > limit || chunk_count(header) > 0xFFFFFFFFu)) ||
+        (striped && (compressed || chunked || stripe->index >= stripe->count || stripe->count > STEGO_MAX_FIELD_SIZE ||
+                     stripe->total_size > limit || stripe->offset > stripe->total_size ||
+                     header->secret_size > stripe->total_size - stripe->offset)) ||
+        (compressed ? header->original_size > limit || stego_header_size(header) > pixels_size
+                    : header->secret_size > limit || stego_required_size(header) > pixels_size)){
+        return failure;
+    }
+
+    //Step 2 : Secret data, compressed as a stream, chunked or split over the threads, scattered in blocks with a key
+    char *data = pixels + stego_header_size(header);
+    size_t data_size = pixels + pixels_size - data;
+    ScatterMap map;
+    if (scattered){
+        scatter_map_init(&map, header->key, data_size);
+    }
+
+    if (striped){
+        char record[STEGO_STRIPE_WIDE_RECORD_SIZE];
+        put_u64(stripe->set_id, record);
+        put_u32(stripe->index, record + 8);
+        put_u32(stripe->count, record + 12);
+        put_size(header, stripe->total_size, record + 16);
+        put_size(header, stripe->offset, record + 16 + size_width(header));
+        stream_transfer(data, 0, scattered ? &map : NULL, record, record_size(header), header->bits, 0);
+
+        // The part itself goes after the record, straight or through the block permutation
+        size_t skip = part_offset(header);
+        if (scattered){
+            stream_transfer(data, skip, &map, (char *)secret, header->secret_size, header->bits, 0);
+        }
+        else if (encode_data_to_lsb_parallel(secret, header->secret_size, data + skip, header->bits, threads) != success){
+            return failure;
+        }
+    }
+    else if (chunked){
+        char index[STEGO_INDEX_HEADER_SIZE];
+        put_u32(STEGO_INDEX_VERSION, index);
+        put_u32(header->chunk_size, index + 4);
+        put_u32(chunk_count(header), index + 8);
+        stream_transfer(data, 0, scattered ? &map : NULL, index, STEGO_INDEX_HEADER_SIZE, header->bits, 0);
+
+        ChunkStripe whole = {data, scattered ? &map : NULL, scattered ? scatter_capacity(data_size) : data_size, header,
+                             (char *)secret, 0, header->secret_size, 0, chunk_count(header), 0, success};
+        if (run_chunked(&whole, threads) != success){
+            return failure;
+        }
+    }
+    else if (compressed){
+        LsbWriter writer = {data, 0, scattered ? scatter_capacity(data_size) : data_size, scattered ? &map : NULL, header->bits, {0}, 0, 0};
+        if (embed_compressed(&writer, header, secret, header->original_size, scratch) != success || writer.size > limit){
+            return failure;
+        }
+        header->secret_size = writer.size;
+    }
+    else if (scattered){
+        if (scatter_encode(secret, header->secret_size, data, data_size, header->bits, header->key, threads) != success){
+            return failure;
+        }
+    }
+    else if (encode_data_to_lsb_parallel(secret, header->secret_size, data, header->bits, threads) != success){
+        return failure;
+    }
+
+    //Step 3 : The header last, the compressed size is only known now
+    return stego_embed_header(pixels, pixels_size, header);
+}
+
+/* Embed only bytes [offset, offset + length) of a flat or scattered secret, from a group on */
+Status stego_embed_range(char *pixels, size_t pixels_size, const StegoHeader *header, const char *secret,
+                         size_t offset, size_t length, int threads){
+
+    int scattered = (header->flags & STEGO_FLAG_SCATTERED) != 0;
+    char *data = pixels + stego_header_size(header);
+    ScatterMap map;
+
+    //Step 1 : The range has to be whole groups inside a secret that is laid out byte after byte
+    if ((header->flags & (STEGO_FLAG_COMPRESSED | STEGO_FLAG_CHUNKED | STEGO_FLAG_STRIPED)) ||
+        header->bits < 1 || header->bits > LSB_MAX_BITS || (header->flags & ~STEGO_KNOWN_FLAGS) != 0 ||
+        header->secret_size > max_size(header) || stego_required_size(header) > pixels_size ||
+        (scattered && !has_key(header)) || offset > header->secret_size || length > header->secret_size - offset ||
+        offset % header->bits != 0 || (offset + length != header->secret_size && (offset + length) % header->bits != 0)){
+        return failure;
+    }
+    if (length == 0){
+        return success;
+    }
+
+    //Step 2 : Byte i is in group i / bits
+    size_t pos = offset / header->bits * 8;
+    if (scattered){
+        scatter_map_init(&map, header->key, pixels + pixels_size - data);
+        stream_transfer(data, pos, &map, (char *)secret, length, header->bits, 0);
+        return success;
+    }
+    return encode_data_to_lsb_parallel(secret, length, data + pos, header->bits, threads);
+}
+
+/* Read the first size bytes of the data, *found stays 0 for a scattered secret without the key */
+static Status read_data_start(const char *pixels, size_t pixels_size, const StegoHeader *header, char *out, size_t size, int *found){
+
+    int scattered = (header->flags & STEGO_FLAG_SCATTERED) != 0;
+    size_t header_size = stego_header_size(header);
+    ScatterMap map;
+
+    *found = 0;
+    if (scattered && !has_key(header)){
+        return success;
+    }
+    if (header_size + region_image_size(header, lsb_image_size(size, header->bits)) > pixels_size){
+        return failure;
+    }
+    if (scattered){
+        scatter_map_init(&map, header->key, pixels_size - header_size);
+    }
+    stream_transfer((char *)pixels + header_size, 0, scattered ? &map : NULL, out, size, header->bits, 1);
+    *found = 1;
+    return success;
+}
+
+/* Read the chunk size from the index, it stays 0 for a scattered secret without the key */
+static Status read_index_header(const char *pixels, size_t pixels_size, StegoHeader *header){
+
+    char index[STEGO_INDEX_HEADER_SIZE];
+    int found;
+
+    if (read_data_start(pixels, pixels_size, header, index, STEGO_INDEX_HEADER_SIZE, &found) != success){
+        return failure;
+    }
+    if (!found){
+        return success;
+    }
+
+    // Only this version of the index is understood
+    header->chunk_size = get_u32(index + 4);
+    if (get_u32(index) != STEGO_INDEX_VERSION || header->chunk_size == 0 || header->chunk_size > STEGO_MAX_FIELD_SIZE ||
+        get_u32(index + 8) != chunk_count(header)){
+        header->chunk_size = 0;
+        return failure;
+    }
+    return success;
+}
+
+/* Read the record of a striped part, it stays zero for a scattered secret without the key */
+static Status read_stripe_record(const char *pixels, size_t pixels_size, StegoHeader *header){
+
+    char record[STEGO_STRIPE_WIDE_RECORD_SIZE];
+    StegoStripe *stripe = &header->stripe;
+    int found;
+
+    if (read_data_start(pixels, pixels_size, header, record, record_size(header), &found) != success){
+        return failure;
+    }
+    if (!found){
+        return success;
+    }
+
+    // The part has to be one of the set, and inside the payload
+    stripe->set_id = get_u64(record);
+    stripe->index = get_u32(record + 8);
+    stripe->count = get_u32(record + 12);
+    stripe->total_size = get_size(header, record + 16);
+    stripe->offset = get_size(header, record + 16 + size_width(header));
+    if (stripe->index >= stripe->count || stripe->total_size > max_size(header) ||
+        stripe->offset > stripe->total_size || header->secret_size > stripe->total_size - stripe->offset){
+        memset(stripe, 0, sizeof(*stripe));
+        return failure;
+    }
+    return success;
+}
+
+/* Read and validate the header embedded in the pixels */
+Status stego_read_header(const char *pixels, size_t pixels_size, StegoHeader *header){
+
+    size_t magic_len = strlen(MAGIC_STRING);
+    char magic[magic_len];
+    char fields[FIELDS_SIZE(MAX_EXTN_SIZE, 8)];
+
+    //Step 1 : Magic string, the extended one is followed by the format word
+    if (pixels_size < (magic_len + 4) * 8){
+        return failure;
+    }
+    decode_data_from_lsb(magic, magic_len, pixels);
+
+    if (memcmp(magic, MAGIC_STRING, magic_len) == 0){
+        header->bits = 1;
+        header->flags = 0;
+    }
+    else if (memcmp(magic, MAGIC_STRING_EXT, magic_len) == 0){
+        char format[4];
+        decode_data_from_lsb(format, 4, pixels + magic_len * 8);
+        size_t word = get_u32(format);
+        header->bits = word & STEGO_FORMAT_BITS_MASK;
+        header->flags = word >> STEGO_FORMAT_FLAGS_SHIFT;
+        if (header->bits < 1 || header->bits > LSB_MAX_BITS || (header->flags & ~STEGO_KNOWN_FLAGS) != 0){
+            return failure;
+        }
+    }
+    else{
+        return failure;
+    }
+    header->extn[0] = '\0';
+
+    //Step 2 : Extension size, the fields have to be inside the pixels
+    size_t offset = prefix_size(header);
+    if (pixels_size < offset + lsb_image_size(FIELDS_SIZE(0, size_width(header)), header->bits)){
+        return failure;
+    }
+    decode_data_from_lsb_k(fields, 4, pixels + offset, header->bits);
+    size_t extn_size = get_u32(fields);
+    if (extn_size > MAX_EXTN_SIZE || pixels_size < offset + lsb_image_size(FIELDS_SIZE(extn_size, size_width(header)), header->bits)){
+        return failure;
+    }
+
+    //Step 3 : Extension and secret size
+    decode_data_from_lsb_k(fields, FIELDS_SIZE(extn_size, size_width(header)), pixels + offset, header->bits);
+    memcpy(header->extn, fields + 4, extn_size);
+    header->extn[extn_size] = '\0';
+    header->secret_size = get_size(header, fields + 4 + extn_size);
+    if (header->secret_size > max_size(header)){
+        return failure;
+    }
+
+    //Step 4 : A chunked secret starts with the index, its chunk size gives the end of the secret,
+    //         and a striped one with its record
+    header->chunk_size = 0;
+    memset(&header->stripe, 0, sizeof(header->stripe));
+    if ((header->flags & STEGO_FLAG_CHUNKED) &&
+        ((header->flags & STEGO_FLAG_COMPRESSED) || read_index_header(pixels, pixels_size, header) != success)){
+        return failure;
+    }
+    if ((header->flags & STEGO_FLAG_STRIPED) &&
+        ((header->flags & (STEGO_FLAG_COMPRESSED | STEGO_FLAG_CHUNKED)) || read_stripe_record(pixels, pixels_size, header) != success)){
+        return failure;
+    }
+
+    //Step 5 : The secret has to be inside the pixels
+    if (stego_required_size(header) > pixels_size){
+        return failure;
+    }
+
+    //Step 6 : A compressed stream starts with the original size, it stays 0 for a scattered one without the key
+    header->original_size = header->secret_size;
+    if (header->flags & STEGO_FLAG_COMPRESSED){
+        int scattered = (header->flags & STEGO_FLAG_SCATTERED) != 0;
+        const char *data = pixels + stego_header_size(header);
+        ScatterMap map;
+
+        header->original_size = 0;
+        if (scattered && !has_key(header)){
+            return success;
+        }
+        if (scattered){
+            scatter_map_init(&map, header->key, pixels + pixels_size - data);
+        }
+        LsbReader reader = {data, 0, scattered ? &map : NULL, header->secret_size, header->bits, {0}, 0, 0};
+        if (reader_get(&reader, fields, size_width(header)) != success){
+            return failure;
+        }
+        header->original_size = get_size(header, fields);
+        if (header->original_size > max_size(header)){
+            return failure;
+        }
+    }
+
+    return success;
+}
+
+/* Extract the secret described by header into secret */
+Status stego_extract(const char *pixels, size_t pixels_size, const StegoHeader *header, char *secret, int threads, void *scratch){
+
+    int scattered = (header->flags & STEGO_FLAG_SCATTERED) != 0;
+    const char *data = pixels + stego_header_size(header);
+    ScatterMap map;
+
+    if (stego_required_size(header) > pixels_size || (scattered && !has_key(header))){
+        return failure;
+    }
+    if (scattered){
+        scatter_map_init(&map, header->key, pixels + pixels_size - data);
+    }
+
+    // Chunks are extracted and checked on their own, split over the threads, a part starts after its record
+    if (header->flags & (STEGO_FLAG_CHUNKED | STEGO_FLAG_STRIPED)){
+        return stego_extract_range(pixels, pixels_size, header, secret, 0, header->secret_size, threads);
+    }
+
+    // The compressed stream is read in order, on the calling thread
+    if (header->flags & STEGO_FLAG_COMPRESSED){
+        LsbReader reader = {data, 0, scattered ? &map : NULL, header->secret_size, header->bits, {0}, 0, 0};
+        return extract_compressed(&reader, header, secret, header->original_size, scratch);
+    }
+    if (scattered){
+        return scatter_decode(secret, header->secret_size, data, pixels + pixels_size - data, header->bits, header->key, threads);
+    }
+
+    return decode_data_from_lsb_parallel(secret, header->secret_size, data, header->bits, threads);
+}
+
+/* Extract only bytes [offset, offset + length) of an uncompressed secret into secret */
+Status stego_extract_range(const char *pixels, size_t pixels_size, const StegoHeader *header, char *secret,
+                           size_t offset, size_t length, int threads){
+
+    int scattered = (header->flags & STEGO_FLAG_SCATTERED) != 0;
+    int chunked = (header->flags & STEGO_FLAG_CHUNKED) != 0;
+    char *data = (char *)pixels + stego_header_size(header);
+    size_t data_size = pixels + pixels_size - data;
+    ScatterMap map;
+
+    //Step 1 : The range has to be inside a secret that can be read at any byte
+    if ((header->flags & STEGO_FLAG_COMPRESSED) || stego_required_size(header) > pixels_size ||
+        (scattered && !has_key(header)) || (chunked && header->chunk_size == 0) ||
+        offset > header->secret_size || length > header->secret_size - offset){
+        return failure;
+    }
+    if (length == 0){
+        return success;
+    }
+    if (scattered){
+        scatter_map_init(&map, header->key, data_size);
+    }
+
+    //Step 2 : Chunked, only the chunks holding the range are extracted and checked
+    if (chunked){
+        size_t first = offset / header->chunk_size;
+        size_t last = (offset + length - 1) / header->chunk_size;
+        ChunkStripe whole = {data, scattered ? &map : NULL, scattered ? scatter_capacity(data_size) : data_size, header,
+                             secret, offset, offset + length, first, last - first + 1, 1, success};
+        return run_chunked(&whole, threads);
+    }
+
+    //Step 3 : Otherwise byte i is in group i / bits, the first group may be cut by the range
+    size_t pos = part_offset(header) + offset / header->bits * 8;
+    size_t skip = offset % header->bits;
+    if (skip > 0){
+        char group[LSB_MAX_BITS];
+        size_t n = (size_t)header->bits - skip < length ? (size_t)header->bits - skip : length;
+        stream_transfer(data, pos, scattered ? &map : NULL, group, skip + n, header->bits, 1);
+        memcpy(secret, group + skip, n);
+        secret += n;
+        length -= n;
+        pos += 8;
+    }
+    if (scattered){
+        stream_transfer(data, pos, &map, secret, length, header->bits, 1);
+        return success;
+    }
+    return decode_data_from_lsb_parallel(secret, length, data + pos, header->bits, threads);
+}
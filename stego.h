@@ -0,0 +1,168 @@
+#ifndef STEGO_H
+#define STEGO_H
+
+/*
+ * libstego : in memory LSB embedding and extraction.
+ *
+ * The functions work only on buffers given by the caller : no FILE*, no
+ * printing and no shared state, so they can be called from any number of
+ * threads at once. "pixels" is the pixel array of the image (bfOffBits on).
+ *
+ * Classic layout (1 LSB per pixel byte, no flags), every byte spread over
+ * the LSB of 8 pixel bytes :
+ *     MAGIC_STRING | extn size (32 bits) | extn | secret size (32 bits) | secret
+ *
+ * Extended layout, the magic string and format word always use 1 LSB, the
+ * rest uses the number of LSBs given in the format word :
+ *     MAGIC_STRING_EXT | format word (32 bits) | extn size | extn | secret size | secret
+ * The fields and the secret each start on a new pixel byte.
+ *
+ * With STEGO_FLAG_COMPRESSED the secret size field is the size of the
+ * compressed stream, which is made of the original size (32 bits) and then
+ * the blocks of compress.h, each one preceded by its size (32 bits, the top
+ * bit set when the block is stored as is).
+ *
+ * With STEGO_FLAG_SCATTERED only the header stays in place, the data after
+ * it goes to keyed blocks of the pixels (scatter.h), so it needs the key.
+ *
+ * With STEGO_FLAG_CHUNKED (not compressed) the secret is cut into chunks of
+ * a fixed size, listed by an index that comes first :
+ *     version (32 bits) | chunk size (32 bits) | chunk count (32 bits) |
+ *     per chunk : offset (32 bits) | length (32 bits) | CRC-32C (32 bits)
+ * followed by the chunks. Each chunk starts on a new group of pixel bytes,
+ * at its offset counted from the end of the header, so any chunk can be
+ * extracted and checked on its own.
+ *
+ * With STEGO_FLAG_STRIPED (not compressed or chunked) the secret is one part
+ * of a payload cut over a set of images, and starts with a record of it :
+ *     set ID (64 bits) | index (32 bits) | count (32 bits) |
+ *     payload size (32 bits) | offset of the part in the payload (32 bits)
+ * The part follows on a new group of pixel bytes.
+ *
+ * With STEGO_FLAG_WIDE the secret size and the original size are 64 bits,
+ * an index entry is offset (64 bits) | length (64 bits) | CRC-32C (32 bits) |
+ * zero (32 bits), and the payload size and offset of a stripe record are 64
+ * bits. stego_fit_fields sets it when a size doesn't fit the 32 bit fields.
+ */
+
+/* Header Files */
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+#include "common.h"
+#include "compress.h"
+
+/* Format word : LSBs per pixel byte in the low bits, flags above them */
+#define STEGO_FORMAT_BITS_MASK 0xF
+#define STEGO_FORMAT_FLAGS_SHIFT 4
+
+/* The secret is compressed with the block codec of compress.h */
+#define STEGO_FLAG_COMPRESSED 0x1
+
+/* The secret is spread over keyed blocks of the pixels (scatter.h) */
+#define STEGO_FLAG_SCATTERED 0x2
+
+/* The secret is split into chunks listed by an index */
+#define STEGO_FLAG_CHUNKED 0x4
+
+/* The secret is one part of a payload striped over several images */
+#define STEGO_FLAG_STRIPED 0x8
+
+/* The size fields are 64 bits */
+#define STEGO_FLAG_WIDE 0x10
+
+/* Flags understood by this version */
+#define STEGO_KNOWN_FLAGS (STEGO_FLAG_COMPRESSED | STEGO_FLAG_SCATTERED | STEGO_FLAG_CHUNKED | STEGO_FLAG_STRIPED | STEGO_FLAG_WIDE)
+
+/* Version of the chunk index written by this version */
+#define STEGO_INDEX_VERSION 1
+
+/* Bytes of the index before the entries, and of every entry */
+#define STEGO_INDEX_HEADER_SIZE 12
+#define STEGO_INDEX_ENTRY_SIZE 12
+#define STEGO_INDEX_WIDE_ENTRY_SIZE 24
+
+/* Chunk size of --chunked */
+#define STEGO_CHUNK_SIZE (1024 * 1024)
+
+/* Bytes of the record before a striped part */
+#define STEGO_STRIPE_RECORD_SIZE 24
+#define STEGO_STRIPE_WIDE_RECORD_SIZE 32
+
+/* Largest size the 32 bit fields hold, and the wide ones (kept far from overflowing the pixel byte counts) */
+#define STEGO_MAX_FIELD_SIZE ((size_t)0x7FFFFFFF)
+#define STEGO_MAX_WIDE_SIZE ((size_t)1 << 56)
+
+/* stego_read_header never looks past this many pixel bytes, the fields are followed by the
+ * original size of a compressed secret, the start of the index or the stripe record */
+#define STEGO_MAX_HEADER_SIZE ((sizeof(MAGIC_STRING) - 1 + 4 + 4 + MAX_EXTN_SIZE + 8 + STEGO_STRIPE_WIDE_RECORD_SIZE) * 8)
+
+/* Scratch memory of the compressed paths : match finder table and one compressed block */
+#define STEGO_SCRATCH_SIZE (COMPRESS_HASH_SIZE * sizeof(uint32_t) + COMPRESS_BOUND(COMPRESS_BLOCK_SIZE))
+
+/* Place of a striped part in its payload */
+typedef struct StegoStripe
+{
+    uint64_t set_id;               // Same in every image of the set
+    size_t index;                  // Part number, 0 .. count - 1
+    size_t count;                  // Images in the set
+    size_t total_size;             // Bytes of the whole payload
+    size_t offset;                 // Offset of this part in the payload
+} StegoStripe;
+
+/* Description of the embedded secret */
+typedef struct StegoHeader
+{
+    char extn[MAX_EXTN_SIZE + 1];  // Extension of the secret file, may be empty
+    size_t secret_size;            // Size of the embedded data in bytes
+    size_t original_size;          // Size of the secret file, differs when compressed
+    int bits;                      // LSBs per pixel byte, 1..4
+    uint flags;                    // STEGO_FLAG_* bits
+    uint64_t key[2];               // Scatter key, set by the caller and never embedded, zero for none
+    size_t chunk_size;             // Secret bytes per chunk when chunked, read from the index
+    StegoStripe stripe;            // When striped, read from the record
+} StegoHeader;
+
+/* Set STEGO_FLAG_WIDE when a size of the header doesn't fit the 32 bit fields, before
+ * sizing the payload. stego_embed calls it too */
+void stego_fit_fields(StegoHeader *header);
+
+/* Pixel bytes used by the header fields */
+size_t stego_header_size(const StegoHeader *header);
+
+/* Pixel bytes needed for the header and the secret */
+size_t stego_required_size(const StegoHeader *header);
+
+/* Most pixel bytes stego_embed can use, the compressed size is only known once embedded */
+size_t stego_embed_bound(const StegoHeader *header);
+
+/* Embed the header and the secret into the pixels, in place. When compressed,
+ * secret holds header->original_size bytes and header->secret_size is set.
+ * scratch holds STEGO_SCRATCH_SIZE bytes, or is NULL to allocate it when needed */
+Status stego_embed(char *pixels, size_t pixels_size, StegoHeader *header, const char *secret, int threads, void *scratch);
+
+/* Embed only bytes [offset, offset + length) of a secret that is not compressed, chunked or
+ * striped, secret holding those bytes. offset starts a group (a multiple of header->bits) and
+ * the range ends at one or at the end of the secret. The header is embedded with stego_embed_header */
+Status stego_embed_range(char *pixels, size_t pixels_size, const StegoHeader *header, const char *secret,
+                         size_t offset, size_t length, int threads);
+
+/* Embed only the header (magic string, format word and fields) into the first
+ * stego_header_size pixel bytes, the caller writes the secret after it */
+Status stego_embed_header(char *pixels, size_t pixels_size, const StegoHeader *header);
+
+/* Read and validate the header embedded in the pixels. header->key is kept, a scattered
+ * compressed secret needs it to read the original size, which is left 0 without it,
+ * a scattered chunked one to read the chunk size and a scattered striped one the record */
+Status stego_read_header(const char *pixels, size_t pixels_size, StegoHeader *header);
+
+/* Extract the secret described by header into secret, it must hold header->original_size bytes.
+ * scratch is as for stego_embed */
+Status stego_extract(const char *pixels, size_t pixels_size, const StegoHeader *header, char *secret, int threads, void *scratch);
+
+/* Extract only bytes [offset, offset + length) of an uncompressed secret into secret. Only the
+ * chunks of the range are read (and checked) when chunked, only its pixel bytes otherwise */
+Status stego_extract_range(const char *pixels, size_t pixels_size, const StegoHeader *header, char *secret,
+                           size_t offset, size_t length, int threads);
+
+#endif
@@ -0,0 +1,544 @@
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "stream.h"
+#include "stego.h"
+#include "lsb.h"
+#include "carrier.h"
+#include "common.h"
+
+/* State of one streaming encode or decode, released by close_stream_job */
+typedef struct StreamJob
+{
+    StreamReader reader;
+    int reader_open;
+    int in_fd;                // Carrier or stego image, stdin or a file
+    int out_fd;               // Stego image or secret, stdout or a file
+    const char *out_fname;    // Removed on failure, NULL for stdout
+    const char *secret;       // Mapping of the secret (encode)
+    size_t secret_size;
+    char *output;             // Extracted bytes of one chunk (decode)
+    char *lsb;                // Gathered first bytes of the samples of one chunk, for samples wider than a byte
+    CarrierInfo carrier;
+    StegoHeader header;
+    size_t group;             // File bytes of the 8 samples holding one group of secret bits
+    size_t data_start;        // File offset of the first pixel byte of the secret
+    size_t data_end;          // File offset after the last one
+    size_t offset;            // File offset of the chunk being processed
+    char carry[STREAM_CARRY_SIZE];
+    size_t carry_len;         // Bytes of a group split by the chunk before
+} StreamJob;
+
+/* Part of the secret's pixel bytes inside one chunk */
+typedef struct StreamSpan
+{
+    char *pixels;             // First pixel byte of the span in the chunk, at a group start
+    size_t image;             // Pixel bytes of the span
+    size_t keep;              // Bytes of a group split by the chunk end, held back for the next chunk
+    size_t done;              // Secret bytes before the span
+    size_t size;              // Secret bytes of the span
+} StreamSpan;
+
+/* Does the file name stand for stdin / stdout */
+int is_stream_name(const char *fname){
+
+    return fname != NULL && strcmp(fname, STREAM_NAME) == 0;
+}
+
+/* Keep stdout for the data : return a copy of it and send the messages printed afterwards to stderr */
+int stream_claim_stdout(void){
+
+    fflush(stdout);
+    int fd = dup(STDOUT_FILENO);
+    if (fd >= 0){
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    return fd;
+}
+
+/* Read until the buffer is full or the input ends, -1 on error */
+static ssize_t read_full(int fd, char *buffer, size_t size){
+
+    size_t done = 0;
+    while (done < size){
+        ssize_t n = read(fd, buffer + done, size - done);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n < 0){
+            return -1;
+        }
+        if (n == 0){
+            break;
+        }
+        done += n;
+    }
+    return done;
+}
+
+/* Write everything, retrying short writes */
+static Status write_full(int fd, const char *buffer, size_t size){
+
+    while (size > 0){
+        ssize_t n = write(fd, buffer, size);
+        if (n < 0 && errno == EINTR){
+            continue;
+        }
+        if (n <= 0){
+            return failure;
+        }
+        buffer += n;
+        size -= n;
+    }
+    return success;
+}
+
+/* Reader thread : fill the two buffers in turn, each one once the consumer gave it back */
+static void *reader_thread(void *arg){
+
+    StreamReader *r = arg;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    for (int i = 0; ; i ^= 1){
+
+        //Step 1 : Wait for the buffer, or for the consumer to stop
+        pthread_mutex_lock(&r->lock);
+        while (r->full[i] && !r->stop){
+            pthread_cond_wait(&r->cond, &r->lock);
+        }
+        int stop = r->stop;
+        pthread_mutex_unlock(&r->lock);
+        if (stop){
+            return NULL;
+        }
+
+        //Step 2 : Read one chunk, a consumer that has all it needs cancels a read that blocks
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        ssize_t n = read_full(r->fd, r->buffer[i] + STREAM_CARRY_SIZE, STREAM_CHUNK_SIZE);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+        //Step 3 : Hand it over, a short chunk is the last one
+        pthread_mutex_lock(&r->lock);
+        r->length[i] = n < 0 ? 0 : (size_t)n;
+        r->error = n < 0;
+        r->full[i] = 1;
+        pthread_cond_broadcast(&r->cond);
+        pthread_mutex_unlock(&r->lock);
+        if (n < (ssize_t)STREAM_CHUNK_SIZE){
+            return NULL;
+        }
+    }
+}
+
+/* Start reading fd ahead of the consumer */
+static Status reader_open(StreamReader *r, int fd){
+
+    memset(r, 0, sizeof(*r));
+    r->fd = fd;
+    r->buffer[0] = malloc(STREAM_CARRY_SIZE + STREAM_CHUNK_SIZE);
+    r->buffer[1] = malloc(STREAM_CARRY_SIZE + STREAM_CHUNK_SIZE);
+    if (r->buffer[0] == NULL || r->buffer[1] == NULL){
+        free(r->buffer[0]);
+        free(r->buffer[1]);
+        return failure;
+    }
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pthread_create(&r->thread, NULL, reader_thread, r) != 0){
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->cond);
+        free(r->buffer[0]);
+        free(r->buffer[1]);
+        return failure;
+    }
+    return success;
+}
+
+/* Wait for the next chunk, it starts STREAM_CARRY_SIZE bytes into its buffer */
+static Status reader_next(StreamReader *r, char **chunk, size_t *length){
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->full[r->next]){
+        pthread_cond_wait(&r->cond, &r->lock);
+    }
+    int error = r->error;
+    *chunk = r->buffer[r->next] + STREAM_CARRY_SIZE;
+    *length = r->length[r->next];
+    pthread_mutex_unlock(&r->lock);
+
+    return error ? failure : success;
+}
+
+/* Give the chunk taken last back to the reader thread */
+static void reader_release(StreamReader *r){
+
+    pthread_mutex_lock(&r->lock);
+    r->full[r->next] = 0;
+    r->next ^= 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* Stop the reader thread, the rest of the input is left unread */
+static void reader_close(StreamReader *r){
+
+    pthread_mutex_lock(&r->lock);
+    r->stop = 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    pthread_cancel(r->thread);
+    pthread_join(r->thread, NULL);
+
+    pthread_mutex_destroy(&r->lock);
+    pthread_cond_destroy(&r->cond);
+    free(r->buffer[0]);
+    free(r->buffer[1]);
+}
+
+/* Release everything the job holds, the output file is removed on failure */
+static void close_stream_job(StreamJob *job, Status status){
+
+    if (job->reader_open){
+        reader_close(&job->reader);
+    }
+    if (job->in_fd > STDIN_FILENO){
+        close(job->in_fd);
+    }
+    if (job->out_fd >= 0){
+        close(job->out_fd);
+    }
+    if (status != success && job->out_fname != NULL){
+        unlink(job->out_fname);
+    }
+    if (job->secret != NULL){
+        munmap((void *)job->secret, job->secret_size);
+    }
+    free(job->output);
+    free(job->lsb);
+}
+
+/* Open the input (stdin for STREAM_NAME) and start reading it */
+static Status open_stream_input(StreamJob *job, const char *fname){
+
+    job->in_fd = is_stream_name(fname) ? STDIN_FILENO : open(fname, O_RDONLY);
+    if (job->in_fd < 0){
+        perror("open");
+        fprintf(stderr, "ERROR : Unable to open file %s\n", fname);
+        return failure;
+    }
+    posix_fadvise(job->in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (reader_open(&job->reader, job->in_fd) != success){
+        printf("ERROR : Unable to start reading %s\n", fname);
+        return failure;
+    }
+    job->reader_open = 1;
+    return success;
+}
+
+/* Open the output file, unless the caller gave stdout */
+static Status open_stream_output(StreamJob *job, const char *fname, int out_fd){
+
+    if (out_fd >= 0){
+        job->out_fd = out_fd;
+        return success;
+    }
+    job->out_fd = open(fname, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (job->out_fd < 0){
+        perror("open");
+        fprintf(stderr, "ERROR : Unable to open file %s for writing\n", fname);
+        return failure;
+    }
+    job->out_fname = fname;
+    return success;
+}
+
+/* Take the next chunk, with the held back bytes of a split group put back in front of it */
+static Status next_chunk(StreamJob *job, char **start, size_t *length, int *last){
+
+    char *chunk;
+    if (reader_next(&job->reader, &chunk, length) != success){
+        perror("read");
+        return failure;
+    }
+    *last = *length < STREAM_CHUNK_SIZE;
+    *start = chunk - job->carry_len;
+    memcpy(*start, job->carry, job->carry_len);
+    *length += job->carry_len;
+    job->carry_len = 0;
+    return success;
+}
+
+/* Parse the carrier header at the start of the first chunk and find where the secret is */
+static Status parse_stream_header(StreamJob *job, const char *start, size_t length){
+
+    if (carrier_parse_header(start, length, &job->carrier) != success || job->carrier.pixel_offset > length){
+        printf("ERROR : Not an uncompressed BMP, PPM, PGM or TGA image nor a 16 bit PCM WAV file\n");
+        return failure;
+    }
+    job->group = 8 * (size_t)job->carrier.sample_size;
+    if (job->carrier.sample_size > 1 && (job->lsb = malloc((STREAM_CARRY_SIZE + STREAM_CHUNK_SIZE) / job->carrier.sample_size)) == NULL){
+        printf("ERROR : Unable to allocate the sample buffer\n");
+        return failure;
+    }
+    return success;
+}
+
+/* The carrier bytes of count samples : the samples themselves, or their first bytes gathered into job->lsb */
+static char *gather_samples(StreamJob *job, char *samples, size_t count){
+
+    if (job->carrier.sample_size == 1){
+        return samples;
+    }
+    carrier_gather(&job->carrier, samples, count, job->lsb);
+    return job->lsb;
+}
+
+/* Put carrier bytes changed in job->lsb back into the samples */
+static void scatter_samples(StreamJob *job, char *samples, size_t count){
+
+    if (job->carrier.sample_size > 1){
+        carrier_scatter(&job->carrier, job->lsb, count, samples);
+    }
+}
+
+/* The secret's pixel bytes in the chunk at job->offset, a group split by the chunk end waits for the next one */
+static void find_span(StreamJob *job, char *start, size_t length, StreamSpan *span){
+
+    size_t from = job->offset > job->data_start ? job->offset : job->data_start;
+    size_t to = job->offset + length < job->data_end ? job->offset + length : job->data_end;
+
+    memset(span, 0, sizeof(*span));
+    if (from >= to){
+        return;
+    }
+    span->pixels = start + (from - job->offset);
+    span->image = to - from;
+    if (to < job->data_end){
+        span->keep = span->image % job->group;
+        span->image -= span->keep;
+    }
+    span->done = (from - job->data_start) / job->group * job->header.bits;
+    span->size = (span->image / job->carrier.sample_size + 7) / 8 * job->header.bits;
+    if (span->size > job->header.secret_size - span->done){
+        span->size = job->header.secret_size - span->done;
+    }
+}
+
+/* Hold back the bytes of a split group, they are processed with the next chunk */
+static size_t hold_back(StreamJob *job, const char *start, size_t length, size_t keep){
+
+    memcpy(job->carry, start + length - keep, keep);
+    job->carry_len = keep;
+    job->offset += length - keep;
+    return length - keep;
+}
+
+/* Encode from a carrier stream into a stego stream */
+Status do_encoding_stream(EncodeInfo *encInfo, int out_fd){
+
+    StreamJob job = {0};
+    job.in_fd = -1;
+    job.out_fd = -1;
+
+    //Step 1 : Only the plain payload is laid out in the order of the pixels
+    if (encInfo->compress || encInfo->chunk_size > 0 || encInfo->key[0] != 0 || encInfo->key[1] != 0){
+        printf("ERROR : --compress, --chunked and --key need the whole image, they can't be streamed\n");
+        return failure;
+    }
+
+    //Step 2 : The secret, its size goes into the header before any pixel is written
+    stats_stage(encInfo->stats, "open");
+    if (map_file_read_only(encInfo->secret_fname, &job.secret, &job.secret_size) != success ||
+        open_stream_input(&job, encInfo->src_image_fname) != success ||
+        open_stream_output(&job, encInfo->stego_image_fname, out_fd) != success){
+        close_stream_job(&job, failure);
+        return failure;
+    }
+    encInfo->size_secret_file = job.secret_size;
+    fill_stego_header(encInfo, &job.header);
+
+    //Step 3 : Chunk by chunk, the next one is read meanwhile
+    stats_stage(encInfo->stats, "stream");
+    int last = 0;
+    while (!last){
+        char *start;
+        size_t length;
+        if (next_chunk(&job, &start, &length, &last) != success){
+            close_stream_job(&job, failure);
+            return failure;
+        }
+
+        //Step 3.1 : The image header and the stego header have to be in the first chunk
+        if (job.offset == 0){
+            size_t header_size = stego_header_size(&job.header);
+            if (parse_stream_header(&job, start, length) != success){
+                close_stream_job(&job, failure);
+                return failure;
+            }
+            size_t sample_size = job.carrier.sample_size;
+            if (stego_required_size(&job.header) > job.carrier.pixel_size / sample_size){
+                printf("ERROR : Image doesn't has enough capacity to hold the data\n");
+                close_stream_job(&job, failure);
+                return failure;
+            }
+            char *samples = start + job.carrier.pixel_offset;
+            if (job.carrier.pixel_offset + header_size * sample_size > length ||
+                stego_embed_header(gather_samples(&job, samples, header_size), header_size, &job.header) != success){
+                printf("ERROR : The image ends before the stego header\n");
+                close_stream_job(&job, failure);
+                return failure;
+            }
+            scatter_samples(&job, samples, header_size);
+            job.data_start = job.carrier.pixel_offset + header_size * sample_size;
+            job.data_end = job.carrier.pixel_offset + stego_required_size(&job.header) * sample_size;
+            if(!encInfo->quiet) printf("INFO : Image has enough capacity to encode the secret data into it\n");
+        }
+
+        //Step 3.2 : The secret bytes whose pixels are in this chunk
+        StreamSpan span;
+        find_span(&job, start, length, &span);
+        size_t count = span.image / job.carrier.sample_size;
+        if (span.size > 0 &&
+            encode_data_to_lsb_parallel(job.secret + span.done, span.size, gather_samples(&job, span.pixels, count), job.header.bits, encInfo->threads) != success){
+            printf("ERROR : Unable to encode the secret data\n");
+            close_stream_job(&job, failure);
+            return failure;
+        }
+        if (span.size > 0){
+            scatter_samples(&job, span.pixels, count);
+        }
+
+        //Step 3.3 : Write it out, except a group the chunk end splits
+        size_t ready = hold_back(&job, start, length, span.keep);
+        if (write_full(job.out_fd, start, ready) != success){
+            perror("write");
+            printf("ERROR : Unable to write the stego image\n");
+            close_stream_job(&job, failure);
+            return failure;
+        }
+        reader_release(&job.reader);
+    }
+
+    //Step 4 : A short input can end before the secret is written
+    if (job.offset < job.data_end || job.carry_len > 0){
+        printf("ERROR : The image ends before the secret data, it is truncated\n");
+        close_stream_job(&job, failure);
+        return failure;
+    }
+    if(!encInfo->quiet) printf("INFO : Secret data of %zu bytes streamed into %zu image bytes\n", job.secret_size, job.offset);
+
+    stats_stage(encInfo->stats, "close");
+    close_stream_job(&job, success);
+    return success;
+}
+
+/* Decode from a stego stream, the secret is written as it is extracted */
+Status do_decoding_stream(DecodeInfo *decInfo, int out_fd){
+
+    StreamJob job = {0};
+    job.in_fd = -1;
+    job.out_fd = -1;
+
+    //Step 1 : Open the stego image, the output is opened once its name is known
+    if (decInfo->range){
+        printf("ERROR : --range needs a file, not a stream\n");
+        return failure;
+    }
+    stats_stage(decInfo->stats, "open");
+    job.output = malloc((STREAM_CARRY_SIZE + STREAM_CHUNK_SIZE) / 8 * LSB_MAX_BITS + LSB_MAX_BITS);
+    if (job.output == NULL || open_stream_input(&job, decInfo->stego_image_fname) != success){
+        close_stream_job(&job, failure);
+        return failure;
+    }
+
+    //Step 2 : Chunk by chunk, stopping as soon as the secret is out
+    stats_stage(decInfo->stats, "stream");
+    int last = 0;
+    while (!last && (job.offset == 0 || job.offset < job.data_end)){
+        char *start;
+        size_t length;
+        if (next_chunk(&job, &start, &length, &last) != success){
+            close_stream_job(&job, failure);
+            return failure;
+        }
+
+        //Step 2.1 : Headers from the first chunk, the stego one read from a copy bounded like scan does
+        if (job.offset == 0){
+            char head[STEGO_MAX_HEADER_SIZE] = {0};
+            if (parse_stream_header(&job, start, length) != success){
+                close_stream_job(&job, failure);
+                return failure;
+            }
+            size_t sample_size = job.carrier.sample_size;
+            size_t n = (length - job.carrier.pixel_offset) / sample_size;
+            n = n < sizeof(head) ? n : sizeof(head);
+            memcpy(head, gather_samples(&job, start + job.carrier.pixel_offset, n), n);
+            if (stego_read_header(head, job.carrier.pixel_size / sample_size, &job.header) != success){
+                printf("ERROR : This file doesn't contain any secret data (not a stego file)\n");
+                close_stream_job(&job, failure);
+                return failure;
+            }
+            if (job.header.flags & (STEGO_FLAG_COMPRESSED | STEGO_FLAG_SCATTERED | STEGO_FLAG_CHUNKED | STEGO_FLAG_STRIPED)){
+                printf("ERROR : A compressed, scattered, chunked or striped secret needs the whole image, it can't be streamed\n");
+                close_stream_job(&job, failure);
+                return failure;
+            }
+            if(!decInfo->quiet) printf("INFO : Magic string, extension and size decoded successfully (%d bits per channel)\n", job.header.bits);
+
+            strcpy(decInfo->extn_secret_file, job.header.extn);
+            decInfo->extn_size = strlen(job.header.extn);
+            decInfo->size_secret_file = job.header.secret_size;
+            set_default_secret_fname(decInfo);
+            if (decInfo->size_secret_file == 0){
+                printf("ERROR : Decoded secret file size is invalid\n");
+                close_stream_job(&job, failure);
+                return failure;
+            }
+            if (open_stream_output(&job, decInfo->secret_fname, out_fd) != success){
+                close_stream_job(&job, failure);
+                return failure;
+            }
+            job.data_start = job.carrier.pixel_offset + stego_header_size(&job.header) * sample_size;
+            job.data_end = job.carrier.pixel_offset + stego_required_size(&job.header) * sample_size;
+        }
+
+        //Step 2.2 : Extract the secret bytes whose pixels are in this chunk and write them right away
+        StreamSpan span;
+        find_span(&job, start, length, &span);
+        if (span.size > 0){
+            if (decode_data_from_lsb_parallel(job.output, span.size, gather_samples(&job, span.pixels, span.image / job.carrier.sample_size),
+                                              job.header.bits, decInfo->threads) != success){
+                printf("ERROR : Unable to extract the secret data\n");
+                close_stream_job(&job, failure);
+                return failure;
+            }
+            if (write_full(job.out_fd, job.output, span.size) != success){
+                perror("write");
+                printf("ERROR : Unable to write the secret data\n");
+                close_stream_job(&job, failure);
+                return failure;
+            }
+        }
+        hold_back(&job, start, length, span.keep);
+        reader_release(&job.reader);
+    }
+
+    //Step 3 : A short input can end before the secret
+    if (job.offset < job.data_end){
+        printf("ERROR : The image ends before the secret data, it is truncated\n");
+        close_stream_job(&job, failure);
+        return failure;
+    }
+    if(!decInfo->quiet) printf("INFO : Secret file data successfully extracted to %s\n", out_fd >= 0 ? "stdout" : decInfo->secret_fname);
+
+    stats_stage(decInfo->stats, "close");
+    close_stream_job(&job, success);
+    return success;
+}
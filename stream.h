@@ -0,0 +1,57 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+/* Header Files */
+#include <pthread.h>
+#include "types.h"
+#include "carrier.h"
+#include "encode.h"
+#include "decode.h"
+
+/* File name standing for stdin (carrier) or stdout (stego image, secret) */
+#define STREAM_NAME "-"
+
+/* Bytes read from the input at a time, each of the two buffers holds one chunk */
+#define STREAM_CHUNK_SIZE (1024 * 1024)
+
+/* Room in front of a buffer for the pixel bytes of a group split by the chunk before, 8 samples */
+#define STREAM_CARRY_SIZE (8 * CARRIER_MAX_SAMPLE_SIZE)
+
+/*
+ * Single pass streaming (-e / -d with "-" as a file name). The input is read
+ * forward only, one chunk ahead by a reader thread, while the chunk before is
+ * embedded or extracted and written out, so pipes and sockets work without a
+ * temporary file. Only a flat payload (not compressed, scattered, chunked or
+ * striped) can be streamed. A WAV carrier always takes this path : the first
+ * byte of every sample in a chunk is gathered, embedded or extracted, and put
+ * back, so a recording of any length is never held in memory.
+ */
+
+/* Double buffered forward reader of a file descriptor */
+typedef struct StreamReader
+{
+    int fd;
+    char *buffer[2];          // STREAM_CARRY_SIZE bytes of room, then one chunk
+    size_t length[2];         // Bytes read into each buffer
+    int full[2];              // The buffer waits for the consumer
+    int error;                // A read failed, the last full buffer is the end
+    int stop;                 // The consumer is done, the reader thread exits
+    int next;                 // Buffer the consumer takes next
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} StreamReader;
+
+/* Does the file name stand for stdin / stdout */
+int is_stream_name(const char *fname);
+
+/* Keep stdout for the data : return a copy of it and send the messages printed afterwards to stderr */
+int stream_claim_stdout(void);
+
+/* Encode from a carrier stream into a stego stream */
+Status do_encoding_stream(EncodeInfo *encInfo, int out_fd);
+
+/* Decode from a stego stream, the secret is written as it is extracted */
+Status do_decoding_stream(DecodeInfo *decInfo, int out_fd);
+
+#endif
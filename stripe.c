@@ -0,0 +1,417 @@
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include "stripe.h"
+#include "encode.h"
+#include "stego.h"
+#include "carrier.h"
+#include "types.h"
+
+/* One image of the set : its mapping, its part and the result */
+typedef struct StripePart
+{
+    const char *in_fname;      // Carrier to stripe, or stego image to join
+    char out_fname[STRIPE_MAX_NAME];
+    const char *map;           // Mapping of in_fname
+    size_t map_size;
+    CarrierInfo carrier;
+    size_t region;             // Pixel bytes present in the file
+    StegoHeader header;        // Part to embed, or part read back
+    size_t capacity;           // Largest part the carrier holds
+    Status status;
+} StripePart;
+
+/* Work shared by the workers, each one takes the next part */
+typedef struct StripePool
+{
+    StripePart *parts;
+    int count;
+    int next;
+    int threads;               // Threads of one stego_embed / stego_extract
+    char *payload;             // Whole payload, read when striping, written when joining
+    int join;
+    pthread_mutex_t lock;
+} StripePool;
+
+/* Create the file at the given size and map it writable and shared, nothing is mapped for size 0 */
+static Status create_mapped_file(const char *fname, size_t size, char **map){
+
+    *map = NULL;
+    int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0){
+        perror("open");
+        fprintf(stderr, "ERROR : Unable to open file %s\n", fname);
+        return failure;
+    }
+    if (ftruncate(fd, size) != 0){
+        perror("ftruncate");
+        close(fd);
+        return failure;
+    }
+    if (size > 0){
+        void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED){
+            perror("mmap");
+            fprintf(stderr, "ERROR : Unable to map file %s\n", fname);
+            close(fd);
+            return failure;
+        }
+        *map = addr;
+    }
+    close(fd);
+    return success;
+}
+
+/* Map the image and find its pixel array */
+static Status open_part(StripePart *part){
+
+    if (map_file_read_only(part->in_fname, &part->map, &part->map_size) != success){
+        return failure;
+    }
+    if (carrier_parse_header(part->map, part->map_size, &part->carrier) != success || part->carrier.sample_size > 1){
+        printf("ERROR : %s is not an uncompressed BMP, PPM, PGM or TGA image\n", part->in_fname);
+        return failure;
+    }
+    carrier_pixels(&part->carrier, part->map, part->map_size, &part->region);
+    return success;
+}
+
+/* Unmap all the images */
+static void close_parts(StripePart *parts, int count){
+
+    for (int i = 0; i < count; i++){
+        if (parts[i].map != NULL){
+            munmap((void *)parts[i].map, parts[i].map_size);
+        }
+    }
+    free(parts);
+}
+
+/* Largest part the carrier holds with the header of the part, the required size grows with the part */
+static size_t part_capacity(const StripePart *part){
+
+    StegoHeader header = part->header;
+    size_t lo = 0, hi = part->region / 8 * header.bits;
+
+    header.secret_size = 0;
+    if (stego_required_size(&header) > part->region){
+        return 0;
+    }
+    while (lo < hi){
+        header.secret_size = lo + (hi - lo + 1) / 2;
+        if (stego_required_size(&header) <= part->region){
+            lo = header.secret_size;
+        }
+        else{
+            hi = header.secret_size - 1;
+        }
+    }
+    return lo;
+}
+
+/* Copy the carrier into its stego image and embed the part */
+static Status stripe_one(StripePart *part, const char *payload, int threads){
+
+    char *stego;
+    if (create_mapped_file(part->out_fname, part->map_size, &stego) != success){
+        return failure;
+    }
+    memcpy(stego, part->map, part->map_size);
+
+    Status status = stego_embed(stego + part->carrier.pixel_offset, part->region, &part->header,
+                                payload + part->header.stripe.offset, threads, NULL);
+    munmap(stego, part->map_size);
+    if (status != success){
+        printf("ERROR : Unable to encode part %zu into %s\n", part->header.stripe.index, part->out_fname);
+    }
+    return status;
+}
+
+/* Extract the part into its place in the payload */
+static Status join_one(StripePart *part, char *payload, int threads){
+
+    Status status = stego_extract(part->map + part->carrier.pixel_offset, part->region, &part->header,
+                                  payload + part->header.stripe.offset, threads, NULL);
+    if (status != success){
+        printf("ERROR : Unable to decode part %zu from %s\n", part->header.stripe.index, part->in_fname);
+    }
+    return status;
+}
+
+/* Take parts until none is left */
+static void *stripe_worker(void *arg){
+
+    StripePool *pool = arg;
+
+    for (;;){
+        pthread_mutex_lock(&pool->lock);
+        int i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+        if (i >= pool->count){
+            break;
+        }
+        StripePart *part = &pool->parts[i];
+        part->status = pool->join ? join_one(part, pool->payload, pool->threads)
+                                  : stripe_one(part, pool->payload, pool->threads);
+    }
+    return NULL;
+}
+
+/* Run every part on a pool of worker threads, the calling thread is one of them */
+static Status run_parts(StripePart *parts, int count, char *payload, int join, int threads){
+
+    if (threads <= 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (cpus > 0) ? cpus : 1;
+    }
+    int workers = threads < count ? threads : count;
+    StripePool pool = { .parts = parts, .count = count, .next = 0, .threads = threads / workers,
+                        .payload = payload, .join = join };
+    pthread_t tids[workers];
+    int started = 1;
+
+    // Threads left over when there are fewer parts than threads go to each part
+    pthread_mutex_init(&pool.lock, NULL);
+    for (int w = 1; w < workers; w++, started++){
+        if (pthread_create(&tids[w], NULL, stripe_worker, &pool) != 0){
+            break;
+        }
+    }
+    stripe_worker(&pool);
+    for (int w = 1; w < started; w++){
+        pthread_join(tids[w], NULL);
+    }
+    pthread_mutex_destroy(&pool.lock);
+
+    for (int i = 0; i < count; i++){
+        if (parts[i].status != success){
+            return failure;
+        }
+    }
+    return success;
+}
+
+/* Random ID of a new set, the clock when there is no entropy */
+static uint64_t new_set_id(void){
+
+    uint64_t id;
+    if (getrandom(&id, sizeof(id), 0) != sizeof(id)){
+        id = ((uint64_t)time(NULL) << 32) ^ (uint64_t)getpid() ^ (uint64_t)clock();
+    }
+    return id;
+}
+
+/* Cut the payload in proportion to the capacities, what rounding leaves goes to the first carriers with room */
+static void split_payload(StripePart *parts, int count, size_t total, size_t capacity){
+
+    size_t given = 0;
+    for (int i = 0; i < count; i++){
+        size_t size = (size_t)((uint64_t)total * parts[i].capacity / capacity);
+        parts[i].header.secret_size = size;
+        given += size;
+    }
+    for (int i = 0; i < count && given < total; i++){
+        size_t room = parts[i].capacity - parts[i].header.secret_size;
+        size_t extra = (total - given < room) ? total - given : room;
+        parts[i].header.secret_size += extra;
+        given += extra;
+    }
+
+    size_t offset = 0;
+    for (int i = 0; i < count; i++){
+        parts[i].header.stripe.offset = offset;
+        offset += parts[i].header.secret_size;
+    }
+}
+
+/* Embed parts of secret_fname into each carrier, carrier i is written to <out_prefix>.<i> with its extension */
+Status do_stripe(const char *secret_fname, const char *out_prefix, char *carriers[], int count,
+                 int bits, const uint64_t key[2], int threads){
+
+    StripePart *parts = calloc(count, sizeof(*parts));
+    const char *secret = NULL;
+    size_t total;
+    char extn[MAX_EXTN_SIZE + 1];
+
+    //Step 1 : Map the secret, its extension goes into every part
+    if (parts == NULL || map_file_read_only(secret_fname, &secret, &total) != success){
+        free(parts);
+        return failure;
+    }
+    get_secret_file_extn(secret_fname, extn);
+    if (total > STEGO_MAX_WIDE_SIZE){
+        printf("ERROR : The secret is %zu bytes, a striped secret can be at most %zu bytes\n", total, STEGO_MAX_WIDE_SIZE);
+        close_parts(parts, 0);
+        munmap((void *)secret, total);
+        return failure;
+    }
+
+    //Step 2 : Map the carriers and find how much each one holds
+    uint64_t set_id = new_set_id();
+    size_t capacity = 0;
+    Status status = success;
+    for (int i = 0; i < count && status == success; i++){
+        StripePart *part = &parts[i];
+        StegoHeader *header = &part->header;
+
+        part->in_fname = carriers[i];
+        status = open_part(part);
+        if (status == success && (size_t)snprintf(part->out_fname, sizeof(part->out_fname), "%s.%d%s", out_prefix, i, part->carrier.extn) >= sizeof(part->out_fname)){
+            printf("ERROR : Output name %s is too long\n", out_prefix);
+            status = failure;
+            break;
+        }
+
+        strcpy(header->extn, extn);
+        header->bits = bits ? bits : 1;
+        header->flags = STEGO_FLAG_STRIPED;
+        if (key[0] != 0 || key[1] != 0){
+            header->flags |= STEGO_FLAG_SCATTERED;
+            memcpy(header->key, key, sizeof(header->key));
+        }
+        header->stripe.set_id = set_id;
+        header->stripe.index = i;
+        header->stripe.count = count;
+        header->stripe.total_size = total;
+        stego_fit_fields(header);
+        part->capacity = part_capacity(part);
+        capacity += part->capacity;
+    }
+
+    //Step 3 : The carriers together have to hold the secret
+    if (status == success && total > capacity){
+        printf("ERROR : The carriers hold %zu bytes at this depth, the secret is %zu bytes\n", capacity, total);
+        status = failure;
+    }
+
+    //Step 4 : Cut the secret and embed the parts in parallel
+    if (status == success){
+        split_payload(parts, count, total, capacity);
+        for (int i = 0; i < count; i++){
+            parts[i].header.original_size = parts[i].header.secret_size;
+        }
+        status = run_parts(parts, count, (char *)secret, 0, threads);
+    }
+    if (status == success){
+        for (int i = 0; i < count; i++){
+            printf("INFO : Part %d of %d, %zu bytes at offset %zu, written to %s\n", i, count,
+                   parts[i].header.secret_size, parts[i].header.stripe.offset, parts[i].out_fname);
+        }
+    }
+
+    close_parts(parts, count);
+    if (secret != NULL){
+        munmap((void *)secret, total);
+    }
+    return status;
+}
+
+/* Read the part held by each image and check that together they are one whole set */
+static Status read_parts(StripePart *parts, int count, StripePart **order, const uint64_t key[2]){
+
+    //Step 1 : Every image has to hold a part, read with the key when it is scattered
+    for (int i = 0; i < count; i++){
+        StripePart *part = &parts[i];
+        if (open_part(part) != success){
+            return failure;
+        }
+        memcpy(part->header.key, key, sizeof(part->header.key));
+        if (stego_read_header(part->map + part->carrier.pixel_offset, part->region, &part->header) != success){
+            printf("ERROR : %s doesn't contain any secret data (not a stego file)\n", part->in_fname);
+            return failure;
+        }
+        if (!(part->header.flags & STEGO_FLAG_STRIPED)){
+            printf("ERROR : %s doesn't hold a part of a striped secret, use -d\n", part->in_fname);
+            return failure;
+        }
+        if (part->header.stripe.count == 0){
+            printf("ERROR : The secret data is scattered, it needs the --key it was embedded with\n");
+            return failure;
+        }
+    }
+
+    //Step 2 : All of them are of the same set, and each part is given once
+    const StegoStripe *first = &parts[0].header.stripe;
+    if (first->count != (size_t)count){
+        printf("ERROR : The set has %zu parts, %d images are given\n", first->count, count);
+        return failure;
+    }
+    for (int i = 0; i < count; i++){
+        const StegoStripe *stripe = &parts[i].header.stripe;
+        if (stripe->set_id != first->set_id || stripe->count != first->count || stripe->total_size != first->total_size){
+            printf("ERROR : %s holds a part of another set than %s\n", parts[i].in_fname, parts[0].in_fname);
+            return failure;
+        }
+        if (order[stripe->index] != NULL){
+            printf("ERROR : %s and %s hold the same part %zu\n", order[stripe->index]->in_fname, parts[i].in_fname, stripe->index);
+            return failure;
+        }
+        order[stripe->index] = &parts[i];
+    }
+
+    //Step 3 : In order, the parts follow each other and end at the end of the payload
+    size_t offset = 0;
+    for (int i = 0; i < count; i++){
+        if (order[i]->header.stripe.offset != offset){
+            printf("ERROR : Part %d in %s doesn't follow part %d\n", i, order[i]->in_fname, i - 1);
+            return failure;
+        }
+        offset += order[i]->header.secret_size;
+    }
+    if (offset != first->total_size){
+        printf("ERROR : The parts hold %zu of the %zu bytes of the secret\n", offset, first->total_size);
+        return failure;
+    }
+    return success;
+}
+
+/* Join the parts held by the stego images, given in any order, into output_fname */
+Status do_join(const char *output_fname, char *images[], int count, const uint64_t key[2], int threads){
+
+    StripePart *parts = calloc(count, sizeof(*parts));
+    StripePart **order = calloc(count, sizeof(*order));
+    char *payload = NULL;
+
+    if (parts == NULL || order == NULL){
+        free(parts);
+        free(order);
+        return failure;
+    }
+    for (int i = 0; i < count; i++){
+        parts[i].in_fname = images[i];
+    }
+
+    //Step 1 : Read and check the parts
+    Status status = read_parts(parts, count, order, key);
+    size_t total = (status == success) ? parts[0].header.stripe.total_size : 0;
+
+    //Step 2 : Extract every part into its place in the output, in parallel
+    int created = 0;
+    if (status == success){
+        status = create_mapped_file(output_fname, total, &payload);
+        created = 1;
+    }
+    if (status == success){
+        status = run_parts(parts, count, payload, 1, threads);
+    }
+    if (status == success){
+        printf("INFO : %d parts, %zu bytes joined into %s\n", count, total, output_fname);
+    }
+
+    if (payload != NULL){
+        munmap(payload, total);
+    }
+    if (created && status == failure){
+        unlink(output_fname);
+    }
+    free(order);
+    close_parts(parts, count);
+    return status;
+}
@@ -0,0 +1,27 @@
+#ifndef STRIPE_H
+#define STRIPE_H
+
+/* Header Files */
+#include <stddef.h>
+#include <stdint.h>
+#include "types.h"
+
+/*
+ * Striping (stripe / join) cuts one payload into parts, one per carrier, sized
+ * to the capacity of each carrier. Every part records the set ID, its index,
+ * the count of images and its offset in the payload (STEGO_FLAG_STRIPED), so
+ * the stego images can be joined back in any order. The carriers are encoded,
+ * and the parts extracted, on a pool of worker threads.
+ */
+
+/* Longest name of a stego image written by stripe */
+#define STRIPE_MAX_NAME 4096
+
+/* Embed parts of secret_fname into each carrier, carrier i is written to <out_prefix>.<i> with its extension */
+Status do_stripe(const char *secret_fname, const char *out_prefix, char *carriers[], int count,
+                 int bits, const uint64_t key[2], int threads);
+
+/* Join the parts held by the stego images, given in any order, into output_fname */
+Status do_join(const char *output_fname, char *images[], int count, const uint64_t key[2], int threads);
+
+#endif
@@ -0,0 +1,51 @@
+// Header files
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "tga.h"
+#include "carrier.h"
+#include "types.h"
+
+/* Little endian fields of the header */
+static uint16_t get_u16(const char *buffer){
+
+    const unsigned char *b = (const unsigned char *)buffer;
+    return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+/* Parse the header of an uncompressed TGA file, 8 bit grey, 24 bit BGR or 32 bit BGRA */
+Status tga_parse_header(const char *buffer, size_t size, CarrierInfo *tga){
+
+    const unsigned char *b = (const unsigned char *)buffer;
+
+    //Step 1 : There is no signature, so every field has to hold a value we accept
+    if (size < TGA_HEADER_SIZE){
+        return failure;
+    }
+    unsigned id_length = b[0];
+    unsigned map_type = b[1];
+    unsigned image_type = b[2];
+    unsigned map_length = get_u16(buffer + 5);
+    unsigned map_entry_bits = b[7];
+    unsigned descriptor = b[17];
+
+    tga->width = get_u16(buffer + 12);
+    tga->height = get_u16(buffer + 14);
+    tga->bpp = b[16];
+
+    //Step 2 : Only uncompressed true color and grey, a color map is allowed but not used by them
+    if (map_type > 1 || (map_type == 0 && (map_length != 0 || map_entry_bits != 0)) ||
+        (map_type == 1 && map_entry_bits != 15 && map_entry_bits != 16 && map_entry_bits != 24 && map_entry_bits != 32) ||
+        !((image_type == TGA_TRUE_COLOR && (tga->bpp == 24 || tga->bpp == 32)) || (image_type == TGA_GREY && tga->bpp == 8)) ||
+        tga->width == 0 || tga->height == 0 || (descriptor & 0xC0) != 0){
+        return failure;
+    }
+
+    //Step 3 : The pixels follow the image ID and the color map, rows are not padded
+    tga->pixel_offset = TGA_HEADER_SIZE + id_length + (size_t)map_length * ((map_entry_bits + 7) / 8);
+    tga->extn = ".tga";
+    tga->sample_size = 1;
+    tga->pixel_size = (size_t)tga->width * (tga->bpp / 8) * tga->height;
+
+    return success;
+}
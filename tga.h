@@ -0,0 +1,19 @@
+#ifndef TGA_H
+#define TGA_H
+
+/* Header Files */
+#include <stddef.h>
+#include "carrier.h"
+#include "types.h"
+
+/* Fixed part of the header, the image ID and the color map follow it */
+#define TGA_HEADER_SIZE 18
+
+/* Image types : uncompressed true color and uncompressed grey */
+#define TGA_TRUE_COLOR 2
+#define TGA_GREY 3
+
+/* Parse the header of an uncompressed TGA file, 8 bit grey, 24 bit BGR or 32 bit BGRA */
+Status tga_parse_header(const char *buffer, size_t size, CarrierInfo *tga);
+
+#endif
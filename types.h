@@ -16,7 +16,14 @@ typedef enum
     //enumerators
     e_encode,       //0
     e_decode,       //1
-    e_unsupported   //2
+    e_batch,        //2
+    e_scan,         //3
+    e_daemon,       //4
+    e_stripe,       //5
+    e_join,         //6
+    e_index,        //7
+    e_fit,          //8
+    e_unsupported   //9
 } OperationType;
 
 /* Function prototype */
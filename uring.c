@@ -0,0 +1,152 @@
+// Header files
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "uring.h"
+#include "types.h"
+
+/* Set up a ring, fails when io_uring is missing or disabled */
+Status io_ring_init(IoRing *ring, unsigned entries){
+
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+
+    //Step 1 : Create the ring, ENOSYS / EPERM when the kernel doesn't allow it
+    ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0){
+        return failure;
+    }
+    ring->entries = params.sq_entries;
+
+    //Step 2 : Map both queues, they share one mapping on recent kernels
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP){
+        ring->sq_map_size = ring->cq_map_size = (ring->sq_map_size > ring->cq_map_size) ? ring->sq_map_size : ring->cq_map_size;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED){
+        close(ring->fd);
+        return failure;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP){
+        ring->cq_map = ring->sq_map;
+    }
+    else{
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED){
+            munmap(ring->sq_map, ring->sq_map_size);
+            close(ring->fd);
+            return failure;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED){
+        if (ring->cq_map != ring->sq_map){
+            munmap(ring->cq_map, ring->cq_map_size);
+        }
+        munmap(ring->sq_map, ring->sq_map_size);
+        close(ring->fd);
+        return failure;
+    }
+
+    //Step 3 : Pointers into the shared rings
+    char *sq = ring->sq_map;
+    char *cq = ring->cq_map;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    ring->sq_local_tail = ring->sq_submitted = *ring->sq_tail;
+
+    return success;
+}
+
+/* Next free submission entry, NULL when the queue is full */
+struct io_uring_sqe *io_ring_get_sqe(IoRing *ring){
+
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head >= ring->entries){
+        return NULL;
+    }
+
+    unsigned index = ring->sq_local_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    ring->sq_local_tail++;
+
+    return sqe;
+}
+
+/* Fill an entry for a read or a write at offset */
+void io_ring_prep_rw(struct io_uring_sqe *sqe, int opcode, int fd, void *buffer, unsigned length, off_t offset, void *data){
+
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)buffer;
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = (uint64_t)(uintptr_t)data;
+}
+
+/* Submit the prepared entries and wait for at least wait_nr completions */
+Status io_ring_submit_and_wait(IoRing *ring, unsigned wait_nr){
+
+    //Step 1 : Publish the new entries to the kernel
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+    //Step 2 : One system call submits them all and waits
+    unsigned to_submit = ring->sq_local_tail - ring->sq_submitted;
+    int ret;
+    do{
+        ret = syscall(__NR_io_uring_enter, ring->fd, to_submit, wait_nr, wait_nr ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0){
+        return failure;
+    }
+    ring->sq_submitted += ret;
+
+    return success;
+}
+
+/* Oldest completion, NULL when there is none */
+struct io_uring_cqe *io_ring_peek_cqe(IoRing *ring){
+
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)){
+        return NULL;
+    }
+    return &ring->cqes[head & *ring->cq_mask];
+}
+
+/* Hand a completion back to the kernel */
+void io_ring_cqe_seen(IoRing *ring){
+
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/* Unmap and close the ring */
+void io_ring_close(IoRing *ring){
+
+    munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_map != ring->sq_map){
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+}
@@ -0,0 +1,63 @@
+#ifndef URING_H
+#define URING_H
+
+/*
+ * Minimal io_uring ring over the raw system calls (no liburing) : one
+ * submission queue, one completion queue, used from a single thread.
+ */
+
+/* Header Files */
+#include <stddef.h>
+#include <linux/io_uring.h>
+#include "types.h"
+
+typedef struct IoRing
+{
+    int fd;
+    unsigned entries;                // Submission queue entries
+
+    /* Submission queue, shared with the kernel */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned sq_local_tail;          // Entries handed out, published on submit
+    unsigned sq_submitted;           // Entries the kernel has taken
+
+    /* Completion queue, shared with the kernel */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* Mappings */
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;
+    size_t cq_map_size;
+    size_t sqes_size;
+} IoRing;
+
+/* Set up a ring, fails when io_uring is missing or disabled */
+Status io_ring_init(IoRing *ring, unsigned entries);
+
+/* Next free submission entry, NULL when the queue is full */
+struct io_uring_sqe *io_ring_get_sqe(IoRing *ring);
+
+/* Fill an entry for a read or a write at offset */
+void io_ring_prep_rw(struct io_uring_sqe *sqe, int opcode, int fd, void *buffer, unsigned length, off_t offset, void *data);
+
+/* Submit the prepared entries and wait for at least wait_nr completions */
+Status io_ring_submit_and_wait(IoRing *ring, unsigned wait_nr);
+
+/* Oldest completion, NULL when there is none */
+struct io_uring_cqe *io_ring_peek_cqe(IoRing *ring);
+
+/* Hand a completion back to the kernel */
+void io_ring_cqe_seen(IoRing *ring);
+
+/* Unmap and close the ring */
+void io_ring_close(IoRing *ring);
+
+#endif
@@ -0,0 +1,448 @@
+// Header files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "uring_jobs.h"
+#include "uring.h"
+#include "batch.h"
+#include "encode.h"
+#include "decode.h"
+#include "carrier.h"
+#include "stego.h"
+#include "arena.h"
+#include "stats.h"
+#include "types.h"
+
+/* One file read or written as a whole, in chunks */
+typedef struct UringTransfer
+{
+    const char *fname;
+    int fd;
+    int opcode;          // IORING_OP_READ or IORING_OP_WRITE
+    char *buffer;
+    size_t size;
+    size_t next;         // Offset of the first chunk not submitted yet
+} UringTransfer;
+
+struct UringJob;
+
+/* One read or write in flight, the buffer offset is the file offset */
+typedef struct UringOp
+{
+    struct UringJob *job;
+    UringTransfer *transfer;
+    size_t offset;
+    size_t length;
+    struct UringOp *next;   // Free list, or the retries of a short transfer
+} UringOp;
+
+typedef enum
+{
+    e_phase_read,        // Reading the image (and the secret)
+    e_phase_write,       // Writing the output
+    e_phase_done         // Slot is free
+} UringPhase;
+
+/* State of one job in a slot */
+typedef struct UringJob
+{
+    BatchJob *job;
+    EncodeInfo enc;
+    DecodeInfo dec;
+    char *image;
+    size_t image_size;
+    char *secret;
+    size_t secret_size;
+    UringTransfer transfers[2];
+    int ntransfers;
+    UringPhase phase;
+    unsigned inflight;
+    UringOp *retries;
+    int error;
+    double start;
+    size_t bytes;        // Buffer bytes of the job, counted against URING_JOBS_MAX_BYTES
+    Arena *arena;        // Buffers of the job, reset when it finishes
+} UringJob;
+
+typedef struct UringEngine
+{
+    IoRing ring;
+    UringOp ops[URING_QUEUE_DEPTH];
+    UringOp *free_ops;
+    unsigned inflight;
+    size_t finished;
+    unsigned active;     // Slots holding a job
+    size_t bytes;        // Buffer bytes of the jobs in the slots
+    int bits;
+    int compress;
+} UringEngine;
+
+/* Open a file and describe it as a transfer of the job */
+static Status add_transfer(UringJob *uj, const char *fname, int flags, int opcode, char *buffer, size_t size){
+
+    int fd = open(fname, flags | O_CLOEXEC, 0644);
+    if (fd < 0){
+        perror("open");
+        fprintf(stderr, "ERROR : Unable to open file %s\n", fname);
+        return failure;
+    }
+    uj->transfers[uj->ntransfers++] = (UringTransfer){ fname, fd, opcode, buffer, size, 0 };
+    return success;
+}
+
+/* Close the files of the current phase */
+static void close_transfers(UringJob *uj){
+
+    for (int i = 0; i < uj->ntransfers; i++){
+        close(uj->transfers[i].fd);
+    }
+    uj->ntransfers = 0;
+}
+
+/* Size of a file, read into a new buffer */
+static Status add_read_transfer(UringJob *uj, const char *fname, char **buffer, size_t *size){
+
+    struct stat st;
+    if (add_transfer(uj, fname, O_RDONLY, IORING_OP_READ, NULL, 0) != success){
+        return failure;
+    }
+    UringTransfer *transfer = &uj->transfers[uj->ntransfers - 1];
+    if (fstat(transfer->fd, &st) != 0 || (*buffer = arena_alloc(uj->arena, st.st_size)) == NULL){
+        fprintf(stderr, "ERROR : Unable to read file %s\n", fname);
+        return failure;
+    }
+    *size = st.st_size;
+    transfer->buffer = *buffer;
+    transfer->size = *size;
+    return success;
+}
+
+/* Bytes of the files a job reads, the decoded secret is counted once its size is known */
+static size_t job_input_bytes(const BatchJob *job){
+
+    struct stat st;
+    size_t bytes = 0;
+    int files = (job->type == e_encode) ? 2 : 1;
+
+    for (int i = 0; i < files; i++){
+        if (stat(job->args[i], &st) == 0){
+            bytes += st.st_size;
+        }
+    }
+    return bytes;
+}
+
+/* Release everything of the job and store its result */
+static void finish_job(UringEngine *engine, UringJob *uj, Status status){
+
+    while (uj->retries != NULL){
+        UringOp *op = uj->retries;
+        uj->retries = op->next;
+        op->next = engine->free_ops;
+        engine->free_ops = op;
+    }
+    close_transfers(uj);
+    arena_reset(uj->arena);
+    engine->bytes -= uj->bytes;
+    engine->active--;
+
+    uj->job->status = status;
+    uj->job->seconds = stats_now() - uj->start;
+    uj->phase = e_phase_done;
+    engine->finished++;
+}
+
+/* Validate the job like the command line would and queue the reads, bytes being its input size */
+static void start_job(UringEngine *engine, UringJob *uj, BatchJob *job, size_t bytes){
+
+    char *argv[6] = { "uring", NULL, job->args[0], job->args[1], job->args[2], NULL };
+    Status status;
+
+    Arena *arena = uj->arena;
+    memset(uj, 0, sizeof(*uj));
+    uj->arena = arena;
+    uj->job = job;
+    uj->phase = e_phase_read;
+    uj->start = stats_now();
+    uj->bytes = bytes;
+    engine->bytes += bytes;
+    engine->active++;
+
+    // A WAV carrier is streamed, its carrier bytes are not one run, so it runs here as batch runs it
+    const CarrierBackend *backend = carrier_backend_for_name(job->args[0]);
+    if (backend != NULL && backend->streamed){
+        finish_job(engine, uj, run_batch_job(job, uj->arena));
+        return;
+    }
+
+    if (job->type == e_encode){
+        argv[1] = "-e";
+        status = read_and_validate_encode_args(argv, &uj->enc);
+        if (status == success){
+            status = add_read_transfer(uj, uj->enc.src_image_fname, &uj->image, &uj->image_size);
+        }
+        if (status == success){
+            status = add_read_transfer(uj, uj->enc.secret_fname, &uj->secret, &uj->secret_size);
+        }
+    }
+    else{
+        argv[1] = "-d";
+        status = read_and_validate_decode_args(argv, &uj->dec);
+        if (status == success){
+            status = add_read_transfer(uj, uj->dec.stego_image_fname, &uj->image, &uj->image_size);
+        }
+    }
+
+    if (status != success){
+        finish_job(engine, uj, failure);
+    }
+}
+
+/* Embed into the image read in memory, then write it out as a whole */
+static Status embed_job(UringEngine *engine, UringJob *uj){
+
+    EncodeInfo *encInfo = &uj->enc;
+    StegoHeader header;
+
+    //Step 1 : Header and capacity
+    if (carrier_parse_header(uj->image, uj->image_size, &encInfo->src_carrier) != success || encInfo->src_carrier.sample_size > 1){
+        printf("ERROR : %s is not an uncompressed BMP, PPM, PGM or TGA image\n", encInfo->src_image_fname);
+        return failure;
+    }
+    encInfo->image_capacity = carrier_pixel_region(&encInfo->src_carrier, uj->image_size);
+    encInfo->size_secret_file = uj->secret_size;
+    encInfo->bits = engine->bits;
+    encInfo->compress = engine->compress;
+    fill_stego_header(encInfo, &header);
+
+    //Step 2 : Embed, a compressed secret is only known to fit once embedded
+    if ((!encInfo->compress && stego_required_size(&header) > encInfo->image_capacity) ||
+        stego_embed(uj->image + encInfo->src_carrier.pixel_offset, encInfo->image_capacity, &header, uj->secret, 1, arena_alloc(uj->arena, STEGO_SCRATCH_SIZE)) != success){
+        printf("ERROR : %s doesn't has enough capacity to hold the data\n", encInfo->src_image_fname);
+        return failure;
+    }
+
+    //Step 3 : Write the whole image, header and tail included
+    return add_transfer(uj, encInfo->stego_image_fname, O_WRONLY | O_CREAT | O_TRUNC, IORING_OP_WRITE, uj->image, uj->image_size);
+}
+
+/* Extract from the image read in memory, then write the secret out */
+static Status extract_job(UringEngine *engine, UringJob *uj){
+
+    DecodeInfo *decInfo = &uj->dec;
+    StegoHeader header = {0};
+
+    //Step 1 : Header of the image and of the secret
+    if (carrier_parse_header(uj->image, uj->image_size, &decInfo->stego_carrier) != success || decInfo->stego_carrier.sample_size > 1){
+        printf("ERROR : %s is not an uncompressed BMP, PPM, PGM or TGA image\n", decInfo->stego_image_fname);
+        return failure;
+    }
+    size_t pixels_size;
+    const char *pixels = carrier_pixels(&decInfo->stego_carrier, uj->image, uj->image_size, &pixels_size);
+    if (stego_read_header(pixels, pixels_size, &header) != success || header.original_size == 0){
+        printf("ERROR : %s doesn't contain any secret data (not a stego file)\n", decInfo->stego_image_fname);
+        return failure;
+    }
+    if (header.flags & STEGO_FLAG_STRIPED){
+        printf("ERROR : %s holds one part of a striped secret, use join\n", decInfo->stego_image_fname);
+        return failure;
+    }
+    strcpy(decInfo->extn_secret_file, header.extn);
+    set_default_secret_fname(decInfo);
+
+    //Step 2 : Extract into memory
+    uj->secret_size = header.original_size;
+    uj->secret = arena_alloc(uj->arena, uj->secret_size);
+    uj->bytes += uj->secret_size;
+    engine->bytes += uj->secret_size;
+    void *scratch = arena_alloc(uj->arena, STEGO_SCRATCH_SIZE);
+    if (uj->secret == NULL || stego_extract(pixels, pixels_size, &header, uj->secret, 1, scratch) != success){
+        printf("ERROR : Unable to extract the secret data from %s\n", decInfo->stego_image_fname);
+        return failure;
+    }
+
+    //Step 3 : Write the secret
+    return add_transfer(uj, decInfo->secret_fname, O_WRONLY | O_CREAT | O_TRUNC, IORING_OP_WRITE, uj->secret, uj->secret_size);
+}
+
+/* The reads (or the writes) of the job are all done, go on with the next phase */
+static void advance_job(UringEngine *engine, UringJob *uj){
+
+    if (uj->error){
+        finish_job(engine, uj, failure);
+        return;
+    }
+    if (uj->phase == e_phase_write){
+        finish_job(engine, uj, success);
+        return;
+    }
+
+    close_transfers(uj);
+    uj->phase = e_phase_write;
+    Status status = (uj->job->type == e_encode) ? embed_job(engine, uj) : extract_job(engine, uj);
+    if (status != success){
+        finish_job(engine, uj, failure);
+    }
+}
+
+/* Queue the retries and the chunks not submitted yet, as far as the ring has room */
+static int queue_job_ops(UringEngine *engine, UringJob *uj){
+
+    struct io_uring_sqe *sqe;
+
+    //Step 1 : Rest of the short transfers first
+    while (uj->retries != NULL && !uj->error){
+        if ((sqe = io_ring_get_sqe(&engine->ring)) == NULL){
+            return 1;
+        }
+        UringOp *op = uj->retries;
+        uj->retries = op->next;
+        io_ring_prep_rw(sqe, op->transfer->opcode, op->transfer->fd, op->transfer->buffer + op->offset, op->length, op->offset, op);
+        uj->inflight++;
+        engine->inflight++;
+    }
+
+    //Step 2 : New chunks
+    for (int i = 0; i < uj->ntransfers && !uj->error; i++){
+        UringTransfer *transfer = &uj->transfers[i];
+        while (transfer->next < transfer->size){
+            if (engine->free_ops == NULL || (sqe = io_ring_get_sqe(&engine->ring)) == NULL){
+                return 1;
+            }
+            UringOp *op = engine->free_ops;
+            engine->free_ops = op->next;
+            size_t length = transfer->size - transfer->next < URING_CHUNK_SIZE ? transfer->size - transfer->next : URING_CHUNK_SIZE;
+            *op = (UringOp){ uj, transfer, transfer->next, length, NULL };
+            io_ring_prep_rw(sqe, transfer->opcode, transfer->fd, transfer->buffer + op->offset, length, op->offset, op);
+            transfer->next += length;
+            uj->inflight++;
+            engine->inflight++;
+        }
+    }
+
+    // 0 when everything of this phase has been submitted
+    return 0;
+}
+
+/* Submit what the job can, and move it on while its phases have nothing to wait for */
+static void pump_job(UringEngine *engine, UringJob *uj){
+
+    while (uj->phase != e_phase_done){
+        int blocked = queue_job_ops(engine, uj);
+        if (uj->inflight > 0 || (blocked && !uj->error)){
+            return;
+        }
+        advance_job(engine, uj);
+    }
+}
+
+/* Account one completion to its job */
+static void complete_op(UringEngine *engine, UringOp *op, int res){
+
+    UringJob *uj = op->job;
+    uj->inflight--;
+    engine->inflight--;
+
+    //Step 1 : A short transfer goes on from where it stopped
+    if (res > 0 && (size_t)res < op->length){
+        op->offset += res;
+        op->length -= res;
+        op->next = uj->retries;
+        uj->retries = op;
+        return;
+    }
+
+    //Step 2 : Errors, and reads that end early, fail the job
+    if (res <= 0){
+        if (!uj->error){
+            fprintf(stderr, "ERROR : %s %s : %s\n", op->transfer->opcode == IORING_OP_READ ? "Reading" : "Writing",
+                    op->transfer->fname, res < 0 ? strerror(-res) : "unexpected end of file");
+        }
+        uj->error = 1;
+    }
+    op->next = engine->free_ops;
+    engine->free_ops = op;
+}
+
+/* Run encode/decode jobs from this thread with their file I/O on one io_uring */
+Status run_jobs_uring(BatchJob *jobs, size_t count, int bits, int compress){
+
+    UringEngine *engine = calloc(1, sizeof(UringEngine));
+    UringJob *slots = calloc(URING_JOBS_IN_FLIGHT, sizeof(UringJob));
+    Arena *arenas = calloc(URING_JOBS_IN_FLIGHT, sizeof(Arena));
+
+    //Step 1 : Ring and the pool of operations
+    if (engine == NULL || slots == NULL || arenas == NULL || io_ring_init(&engine->ring, URING_QUEUE_DEPTH) != success){
+        free(engine);
+        free(slots);
+        free(arenas);
+        return failure;
+    }
+    for (int i = 0; i < URING_QUEUE_DEPTH; i++){
+        engine->ops[i].next = engine->free_ops;
+        engine->free_ops = &engine->ops[i];
+    }
+    for (int s = 0; s < URING_JOBS_IN_FLIGHT; s++){
+        slots[s].phase = e_phase_done;
+        slots[s].arena = &arenas[s];
+        arena_init(&arenas[s], ARENA_DEFAULT_SIZE);
+    }
+    engine->bits = bits;
+    engine->compress = compress;
+
+    size_t next = 0;
+    size_t next_bytes = (count > 0) ? job_input_bytes(&jobs[0]) : 0;
+    Status status = success;
+    while (engine->finished < count){
+
+        //Step 2 : Fill the free slots with new jobs while their buffers fit, and queue the I/O of every job
+        for (int s = 0; s < URING_JOBS_IN_FLIGHT; s++){
+            while (slots[s].phase == e_phase_done && next < count &&
+                   (engine->active == 0 || engine->bytes + next_bytes <= URING_JOBS_MAX_BYTES)){
+                start_job(engine, &slots[s], &jobs[next], next_bytes);
+                next_bytes = (++next < count) ? job_input_bytes(&jobs[next]) : 0;
+                pump_job(engine, &slots[s]);
+            }
+            pump_job(engine, &slots[s]);
+        }
+        if (engine->finished == count){
+            break;
+        }
+
+        //Step 3 : One system call submits everything and waits for a completion
+        if (io_ring_submit_and_wait(&engine->ring, engine->inflight ? 1 : 0) != success){
+            perror("io_uring_enter");
+            status = failure;
+            break;
+        }
+
+        //Step 4 : Completions
+        struct io_uring_cqe *cqe;
+        while ((cqe = io_ring_peek_cqe(&engine->ring)) != NULL){
+            UringOp *op = (UringOp *)(uintptr_t)cqe->user_data;
+            int res = cqe->res;
+            io_ring_cqe_seen(&engine->ring);
+            complete_op(engine, op, res);
+        }
+    }
+
+    //Step 5 : Closing the ring cancels what a failed io_uring_enter left behind
+    io_ring_close(&engine->ring);
+    for (int s = 0; s < URING_JOBS_IN_FLIGHT; s++){
+        if (slots[s].phase != e_phase_done){
+            finish_job(engine, &slots[s], failure);
+        }
+    }
+    for (int s = 0; s < URING_JOBS_IN_FLIGHT; s++){
+        arena_destroy(&arenas[s]);
+    }
+    free(arenas);
+    free(slots);
+    free(engine);
+
+    return status;
+}
@@ -0,0 +1,33 @@
+#ifndef URING_JOBS_H
+#define URING_JOBS_H
+
+/* Header Files */
+#include <stddef.h>
+#include "types.h"
+#include "batch.h"
+
+/* Submission queue entries of the ring, also the most reads/writes in flight */
+#define URING_QUEUE_DEPTH 256
+
+/* Jobs whose I/O is in flight at the same time */
+#define URING_JOBS_IN_FLIGHT 32
+
+/* Buffer bytes of the jobs in flight, a job that alone is larger still runs by itself */
+#define URING_JOBS_MAX_BYTES ((size_t)512 * 1024 * 1024)
+
+/* Largest single read or write */
+#define URING_CHUNK_SIZE (1024 * 1024)
+
+/*
+ * Run encode/decode jobs from this thread with their file I/O on one
+ * io_uring : every job reads its files, embeds or extracts in memory and
+ * writes its output, while the reads and writes of the other jobs stay in
+ * flight. Each job holds its files in memory, so jobs are started while
+ * their buffers stay under URING_JOBS_MAX_BYTES. A WAV job is streamed on
+ * this thread, as run_batch_job runs it. Fails when the ring can't
+ * be set up or stops working (the caller then uses another path), the
+ * result of each job is in its status.
+ */
+Status run_jobs_uring(BatchJob *jobs, size_t count, int bits, int compress);
+
+#endif
@@ -0,0 +1,89 @@
+// Header files
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "wav.h"
+#include "carrier.h"
+#include "types.h"
+
+/* Little endian fields of the chunks */
+static uint32_t get_u32(const char *buffer){
+
+    const unsigned char *b = (const unsigned char *)buffer;
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+static uint16_t get_u16(const char *buffer){
+
+    const unsigned char *b = (const unsigned char *)buffer;
+    return (uint16_t)(b[0] | (b[1] << 8));
+}
+
+/* Check the fmt chunk : PCM, 16 bit samples, frames of one sample per channel */
+static Status parse_format(const char *fmt, size_t size, CarrierInfo *wav){
+
+    if (size < 16){
+        return failure;
+    }
+    unsigned tag = get_u16(fmt);
+    unsigned channels = get_u16(fmt + 2);
+    unsigned block_align = get_u16(fmt + 12);
+    unsigned bits = get_u16(fmt + 14);
+
+    //The sub format of an extensible fmt starts with the format tag
+    if (tag == WAV_FORMAT_EXTENSIBLE){
+        if (size < 40){
+            return failure;
+        }
+        tag = get_u16(fmt + 24);
+    }
+    if (tag != WAV_FORMAT_PCM || bits != 16 || channels == 0 || block_align != channels * 2){
+        return failure;
+    }
+    wav->width = channels;
+    wav->bpp = bits * channels;
+    return success;
+}
+
+/* Parse the RIFF chunks of a 16 bit PCM WAV file, the data chunk is the carrier */
+Status wav_parse_header(const char *buffer, size_t size, CarrierInfo *wav){
+
+    int have_format = 0;
+
+    //Step 1 : "RIFF" and "WAVE", the sizes are not trusted, a stream may leave them unset
+    if (size < WAV_RIFF_HEADER_SIZE || memcmp(buffer, "RIFF", 4) != 0 || memcmp(buffer + 8, "WAVE", 4) != 0){
+        return failure;
+    }
+
+    //Step 2 : Walk the chunks up to the data one, it has to start inside the buffer
+    for (size_t pos = WAV_RIFF_HEADER_SIZE; pos + WAV_CHUNK_HEADER_SIZE <= size; ){
+        const char *id = buffer + pos;
+        size_t length = get_u32(buffer + pos + 4);
+        pos += WAV_CHUNK_HEADER_SIZE;
+
+        if (memcmp(id, "fmt ", 4) == 0){
+            if (length > size - pos || parse_format(buffer + pos, length, wav) != success){
+                return failure;
+            }
+            have_format = 1;
+        }
+        else if (memcmp(id, "data", 4) == 0){
+
+            //Step 3 : The samples, in frames of one sample per channel. A sample's LSB is in its first byte
+            if (!have_format){
+                return failure;
+            }
+            size_t frame = (size_t)wav->width * 2;
+            wav->pixel_offset = pos;
+            wav->pixel_size = length / frame * frame;
+            wav->height = (int)(wav->pixel_size / frame > 0x7FFFFFFF ? 0x7FFFFFFF : wav->pixel_size / frame);
+            wav->sample_size = 2;
+            wav->extn = ".wav";
+            return wav->pixel_size > 0 ? success : failure;
+        }
+
+        //Chunks are padded to an even size
+        pos += length + (length & 1);
+    }
+    return failure;
+}
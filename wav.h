@@ -0,0 +1,20 @@
+#ifndef WAV_H
+#define WAV_H
+
+/* Header Files */
+#include <stddef.h>
+#include "carrier.h"
+#include "types.h"
+
+/* "RIFF", its size and "WAVE", then the chunks, each one an ID and a size */
+#define WAV_RIFF_HEADER_SIZE 12
+#define WAV_CHUNK_HEADER_SIZE 8
+
+/* Format tags of the fmt chunk, an extensible one gives the real tag in its sub format */
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_EXTENSIBLE 0xFFFE
+
+/* Parse the RIFF chunks of a 16 bit PCM WAV file, the data chunk is the carrier */
+Status wav_parse_header(const char *buffer, size_t size, CarrierInfo *wav);
+
+#endif